@@ -16,6 +16,7 @@ limitations under the License.
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "jwHash.h"
 
 #ifdef HASHTEST
@@ -25,6 +26,15 @@ limitations under the License.
 #ifdef HASHTHREADED
 #include <pthread.h>
 #include <semaphore.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -43,63 +53,2933 @@ static inline long int hashInt(long int x)
 	return x;
 }
 
-// http://www.cse.yorku.ca/~oz/hash.html
-// hash function for string keys djb2
-static inline long int hashString(char * str)
+// http://www.cse.yorku.ca/~oz/hash.html
+// hash function for string keys djb2
+static inline long int hashString(char * str)
+{
+	unsigned long hash = 5381;
+	int c;
+
+	while (c = *str++)
+		hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+	return hash;
+}
+
+// https://github.com/aappleby/smhasher/blob/master/src/MurmurHash3.cpp
+// 64 bit finalizer, every input bit affects every output bit
+static inline unsigned long long mix64(unsigned long long x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb93fe53e87b9ULL;
+	x ^= x >> 33;
+	return x;
+}
+
+// http://www.isthe.com/chongo/tech/comp/fnv/
+// seeded 64 bit string hash FNV-1a, djb2 collides too easily to build a perfect hash on
+static inline unsigned long long hashString64(char * str, unsigned long long seed)
+{
+	unsigned long long hash = 0xcbf29ce484222325ULL ^ seed;
+	int c;
+
+	while ((c = *str++))
+		hash = (hash ^ (unsigned char)c) * 0x100000001b3ULL;
+	return mix64(hash);
+}
+
+// map a hash onto [0,n) with a multiply instead of a divide
+// http://lemire.me/blog/2016/06/27/a-fast-alternative-to-the-modulo-reduction/
+static inline size_t hashrange(unsigned long long hash, size_t n)
+{
+	return (size_t)(((unsigned __int128)hash * n) >> 64);
+}
+
+// helper for copying string keys and values
+static inline char * copystring(char * value)
+{
+	char * copy = (char *)malloc(strlen(value)+1);
+	if(!copy) {
+		printf("Unable to allocate string value %s\n",value);
+		abort();
+	}
+	strcpy(copy,value);
+	return copy;
+}
+
+// Backing memory for buckets, locks and pooled entries. With HASHMEM* flags
+// this is mapped directly so it can sit on 2 MiB pages and be placed on NUMA
+// nodes; without them it's plain calloc. Placement is best effort, memory is
+// still returned if huge pages or mbind aren't available, and the flags that
+// couldn't be honoured are added to *missed.
+#define HASHHUGEPAGE	(2UL<<20)
+#define HASHCHUNKSIZE	HASHHUGEPAGE		// pooled entries are carved from chunks this big
+
+#ifdef __linux__
+#ifndef MPOL_BIND
+#define MPOL_BIND		2
+#define MPOL_INTERLEAVE	3
+#endif
+
+// size actually mapped for a request
+static inline size_t mappedsize(size_t size, int memflags)
+{
+	size_t align = memflags & (HASHMEMHUGE|HASHMEMHUGETLB) ? HASHHUGEPAGE : (size_t)sysconf(_SC_PAGESIZE);
+	return (size+align-1) & ~(align-1);
+}
+#endif
+
+static void *allocmem(size_t size, int memflags, int node, int *missed)
+{
+#ifdef __linux__
+	size_t len;
+	char *mem = MAP_FAILED;
+	int huge = 0;
+	if(!memflags)
+		return calloc(1,size ? size : 1);
+	len = mappedsize(size ? size : 1,memflags);
+#ifdef MAP_HUGETLB
+	if(memflags & HASHMEMHUGETLB)
+		mem = (char *)mmap(NULL,len,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+#endif
+	if(mem==MAP_FAILED && (memflags & HASHMEMHUGETLB))
+		*missed |= HASHMEMHUGETLB;
+	if(mem==MAP_FAILED && (memflags & (HASHMEMHUGE|HASHMEMHUGETLB))) {
+		// over-allocate so the mapping can be trimmed to a huge page boundary
+		char *raw = (char *)mmap(NULL,len+HASHHUGEPAGE,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+		if(raw!=MAP_FAILED) {
+			size_t head = (HASHHUGEPAGE - ((size_t)raw & (HASHHUGEPAGE-1))) & (HASHHUGEPAGE-1);
+			if(head)
+				munmap(raw,head);
+			munmap(raw+head+len,HASHHUGEPAGE-head);
+			mem = raw+head;
+#ifdef MADV_HUGEPAGE
+			huge = 0==madvise(mem,len,MADV_HUGEPAGE);
+#endif
+		}
+		if(!huge)
+			*missed |= HASHMEMHUGE;
+	}
+	if(mem==MAP_FAILED)
+		mem = (char *)mmap(NULL,len,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+	if(mem==MAP_FAILED)
+		return NULL;
+	if(memflags & (HASHMEMBIND|HASHMEMINTERLEAVE)) {
+		int placed = 0;
+#ifdef SYS_mbind
+		// a node mask as wide as HASHMAXNODES, the kernel ignores the last bit of maxnode
+		unsigned long nodes[HASHMAXNODES/(8*sizeof(unsigned long))];
+		memset(nodes,memflags & HASHMEMBIND ? 0 : 0xff,sizeof(nodes));
+		if(memflags & HASHMEMBIND)
+			nodes[node/(8*sizeof(unsigned long))] = 1UL << (node%(8*sizeof(unsigned long)));
+		placed = 0==syscall(SYS_mbind,mem,len,memflags & HASHMEMBIND ? MPOL_BIND : MPOL_INTERLEAVE,
+		                    nodes,(unsigned long)HASHMAXNODES+1,0);
+#endif
+		if(!placed)
+			*missed |= memflags & (HASHMEMBIND|HASHMEMINTERLEAVE);
+	}
+	return mem;
+#else
+	if(memflags)
+		*missed |= memflags;
+	return calloc(1,size ? size : 1);
+#endif
+}
+
+static void freemem(void *mem, size_t size, int memflags)
+{
+	if(!mem)
+		return;
+#ifdef __linux__
+	if(memflags) {
+		munmap(mem,mappedsize(size ? size : 1,memflags));
+		return;
+	}
+#endif
+	free(mem);
+}
+
+struct jwHashChunk
+{
+	jwHashChunk *next;
+	jwHashEntry entries[1];
+};
+
+#define HASHCHUNKENTRIES	((HASHCHUNKSIZE-sizeof(jwHashChunk))/sizeof(jwHashEntry)+1)
+
+// Entry with all of a key's values in the same allocation, see add_multi_by_str
+typedef struct jwHashMulti jwHashMulti;
+struct jwHashMulti
+{
+	jwHashEntry entry;				// valtag HASHMULTI, value.ptrValue points at values
+	size_t count;
+	size_t capacity;
+	long int values[1];
+};
+
+// carve an entry from the newest chunk, table is locked by the caller
+static inline jwHashEntry *chunkentry(jwHashTable *table)
+{
+	if(!table->chunkleft) {
+		jwHashChunk *chunk = (jwHashChunk *)allocmem(HASHCHUNKSIZE,table->memflags,table->memnode,&table->memmissed);
+		if(!chunk)
+			return NULL;
+		chunk->next = table->chunks;
+		table->chunks = chunk;
+		table->chunkleft = HASHCHUNKENTRIES;
+	}
+	return &table->chunks->entries[HASHCHUNKENTRIES - table->chunkleft--];
+}
+
+#ifdef HASHTHREADED
+// lock for entire table, guards the entry freelist
+static inline void locktable(jwHashTable *table)
+{
+	while (__sync_lock_test_and_set(&table->lock, 1)) {
+		// spin
+	}
+}
+
+static inline void unlocktable(jwHashTable *table)
+{
+	__sync_lock_release(&table->lock);
+}
+
+// lock one bucket against changes, as add_int_by_str does
+static inline void lockbucket(jwHashTable *table, size_t hash)
+{
+	while (__sync_lock_test_and_set(&table->locks[hash], 1)) {
+		// spin
+	}
+}
+
+static inline void unlockbucket(jwHashTable *table, size_t hash)
+{
+	__sync_lock_release(&table->locks[hash]);
+}
+#endif
+
+// true if entry lives in the contiguous block from a bulk build
+static inline int bulkentry(jwHashTable *table, jwHashEntry *entry)
+{
+	return table->entries && entry>=table->entries && entry<table->entries+table->entrycount;
+}
+
+// true if entry was carved from one of the table's chunks
+static inline int chunkedentry(jwHashTable *table, jwHashEntry *entry)
+{
+	jwHashChunk *chunk;
+	for(chunk=table->chunks;chunk;chunk=chunk->next)
+		if(entry>=chunk->entries && entry<chunk->entries+HASHCHUNKENTRIES)
+			return 1;
+	return 0;
+}
+
+// true if entry came from the table's own storage rather than malloc,
+// multi entries are always malloc'd since they grow. Only entries malloc'd
+// because a chunk couldn't be mapped need the walk over the chunks.
+static inline int pooledentry(jwHashTable *table, jwHashEntry *entry)
+{
+	if(entry->valtag==HASHMULTI)
+		return 0;
+	if(bulkentry(table,entry))
+		return 1;
+	if(!table->chunks)
+		return 0;
+	return !table->spilled || chunkedentry(table,entry);
+}
+
+// true if string lives in the contiguous block from a bulk build
+static inline int bulkstring(jwHashTable *table, char *str)
+{
+	return table->strings && str>=table->strings && str<table->strings+table->stringsize;
+}
+
+// get an entry, reusing a deleted one if there is one
+static inline jwHashEntry *newentry(jwHashTable *table)
+{
+	jwHashEntry *entry = NULL;
+	if(table->freelist || table->memflags) {
+#ifdef HASHTHREADED
+		locktable(table);
+#endif
+		entry = table->freelist;
+		if(entry)
+			table->freelist = entry->next;
+		else if(table->memflags) {
+			entry = chunkentry(table);
+			if(!entry) {
+				// no chunk, this one has to be told apart when it's freed
+				entry = (jwHashEntry *)malloc(sizeof(jwHashEntry));
+				table->spilled++;
+			}
+		}
+#ifdef HASHTHREADED
+		unlocktable(table);
+#endif
+	}
+	if(!entry)
+		entry = (jwHashEntry *)malloc(sizeof(jwHashEntry));
+	if(!entry) {
+		printf("Unable to allocate hash entry\n");
+		abort();
+	}
+	return entry;
+}
+
+// release an entry, pooled entries go back on the freelist
+static inline void freeentry(jwHashTable *table, jwHashEntry *entry)
+{
+	int pooled;
+	if(!table->memflags && !pooledentry(table,entry)) {
+		free(entry);
+		return;
+	}
+#ifdef HASHTHREADED
+	// the chunk list may be growing
+	locktable(table);
+#endif
+	pooled = pooledentry(table,entry);
+	if(pooled) {
+		entry->next = table->freelist;
+		table->freelist = entry;
+	}
+#ifdef HASHTHREADED
+	unlocktable(table);
+#endif
+	if(!pooled)
+		free(entry);
+}
+
+// release a copied key or value string
+static inline void freestring(jwHashTable *table, char *str)
+{
+	if(!bulkstring(table,str))
+		free(str);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// CREATING A NEW HASH TABLE
+
+static void freefrozen( jwHashFrozen *frozen );
+static void freefilter( jwHashFilter *filter );
+static void freecompress( jwHashCompress *c );
+static void freeindex( jwHashIndex *index );
+static void detachshared( jwHashShared *shm );
+static inline void freevalue( jwHashTable *table, jwHashEntry *entry );
+static inline size_t stringlength( jwHashEntry *entry );
+static inline void copyvalue( jwHashTable *table, jwHashEntry *entry, char *str );
+
+// Create hash table
+jwHashTable *create_hash( size_t buckets )
+{
+	return create_hash_mem(buckets,0,0);
+}
+
+// Create hash table with buckets, locks and entries on huge pages and/or NUMA nodes
+jwHashTable *create_hash_mem( size_t buckets, int memflags, int node )
+{
+	// allocate space
+	jwHashTable *table= (jwHashTable *)malloc(sizeof(jwHashTable));
+	if(!table) {
+		// unable to allocate
+		return NULL;
+	}
+	if((memflags & HASHMEMBIND) && (node<0 || node>=HASHMAXNODES)) {
+		free(table);
+		return NULL;
+	}
+	table->memflags = memflags;
+	table->memnode = node;
+	table->memmissed = 0;
+	table->chunks = NULL;
+	table->chunkleft = 0;
+	table->spilled = 0;
+	// locks
+#ifdef HASHTHREADED
+	table->lock = 0;
+	table->locks = (int *)allocmem(buckets * sizeof(int),memflags,node,&table->memmissed);
+	if( !table->locks ) {
+		free(table);
+		return NULL;
+	}
+#endif
+	// setup
+	table->bucket = (jwHashEntry **)allocmem(buckets*sizeof(void*),memflags,node,&table->memmissed);
+	if( !table->bucket ) {
+#ifdef HASHTHREADED
+		freemem((int *)table->locks,buckets*sizeof(int),memflags);
+#endif
+		free(table);
+		return NULL;
+	}
+	table->buckets = table->bucketsinitial = buckets;
+	table->lastError = HASHOK;
+	table->entries = table->freelist = NULL;
+	table->entrycount = 0;
+	table->strings = NULL;
+	table->stringsize = 0;
+	table->frozen = NULL;
+	table->filter = NULL;
+	table->compress = NULL;
+	table->index = NULL;
+	table->shared = NULL;
+	HASH_DEBUG("table: %x bucket: %x\n",table,table->bucket);
+	return table;
+}
+
+// Free the bucket and lock arrays
+static void freebuckets( jwHashTable *table )
+{
+	freemem(table->bucket,table->buckets*sizeof(void*),table->memflags);
+	table->bucket = NULL;
+#ifdef HASHTHREADED
+	freemem((int *)table->locks,table->buckets*sizeof(int),table->memflags);
+	table->locks = NULL;
+#endif
+	table->buckets = 0;
+}
+
+// Free all entries and copied strings, leaving empty buckets
+static void clearentries( jwHashTable *table )
+{
+	size_t b;
+	for(b=0;b<table->buckets;++b) {
+		jwHashEntry *entry = table->bucket[b];
+		while(entry) {
+			jwHashEntry *next = entry->next;
+			freevalue(table,entry);
+			if( entry->keytag==HASHKEYSTR )
+				freestring(table,entry->key.strValue);
+			if( !pooledentry(table,entry) )
+				free(entry);
+			entry = next;
+		}
+		table->bucket[b] = NULL;
+	}
+	while(table->chunks) {
+		jwHashChunk *next = table->chunks->next;
+		freemem(table->chunks,HASHCHUNKSIZE,table->memflags);
+		table->chunks = next;
+	}
+	table->chunkleft = 0;
+	table->spilled = 0;
+	free(table->entries);
+	free(table->strings);
+	table->entries = table->freelist = NULL;
+	table->entrycount = 0;
+	table->strings = NULL;
+	table->stringsize = 0;
+}
+
+// Delete hash table, all entries and copied strings
+void *delete_hash( jwHashTable *table )
+{
+	if(table->shared) {
+		// other processes may still be using it
+		detachshared(table->shared);
+		free(table);
+		return NULL;
+	}
+	clearentries(table);
+	freefrozen(table->frozen);
+	freefilter(table->filter);
+	freebuckets(table);
+	freecompress(table->compress);
+	freeindex(table->index);
+	free(table);
+	return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// BULK BUILDING FROM AN ARRAY
+
+// Pairs are hashed, grouped by bucket partition, then each partition lays out
+// its buckets' entries contiguously in one block, so there is no per-entry
+// malloc and each chain is a run of adjacent entries.
+
+#ifndef HASHBUILDTHREADS
+#define HASHBUILDTHREADS	16			// most threads used for a build
+#endif
+#define HASHBUILDMINPAIRS	65536		// fewest pairs worth giving a thread
+
+typedef struct jwHashBuild jwHashBuild;
+struct jwHashBuild
+{
+	jwHashTable *table;
+	jwHashPair *pairs;
+	size_t count;
+	HASHKEYTAG keytag;
+	int flags;
+	int threads;					// also the number of bucket partitions
+	size_t perpart;					// buckets per partition
+	size_t *hashes;					// bucket for each pair
+	size_t *order;					// pair indices grouped by partition
+	size_t *counts;					// pairs per [thread][partition], then scatter offsets
+	size_t *bytes;					// string bytes per [thread][partition]
+	size_t partstart[HASHBUILDTHREADS+1];	// first slot in order/entries for each partition
+	size_t partstring[HASHBUILDTHREADS+1];	// first byte in strings for each partition
+	jwHashEntry *freehead[HASHBUILDTHREADS];	// slots left unused by duplicates
+	jwHashEntry *freetail[HASHBUILDTHREADS];
+};
+
+typedef struct jwHashBuildTask jwHashBuildTask;
+struct jwHashBuildTask
+{
+	jwHashBuild *build;
+	int id;
+};
+
+// number of threads to split a build across
+static int buildthreads(size_t count)
+{
+#ifdef HASHTHREADED
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t threads = count / HASHBUILDMINPAIRS;
+	if(cpus>0 && threads>(size_t)cpus)
+		threads = cpus;
+	if(threads>HASHBUILDTHREADS)
+		threads = HASHBUILDTHREADS;
+	return threads ? (int)threads : 1;
+#else
+	(void)count;
+	return 1;
+#endif
+}
+
+// run one build phase on every task, the calling thread takes task 0
+static void buildrun(void *(*func)(void *), jwHashBuildTask *tasks, int threads)
+{
+#ifdef HASHTHREADED
+	pthread_t pth[HASHBUILDTHREADS];
+	int started[HASHBUILDTHREADS];
+	int t;
+	for(t=1;t<threads;++t) {
+		started[t] = 0==pthread_create(&pth[t],NULL,func,&tasks[t]);
+		if(!started[t])
+			func(&tasks[t]);
+	}
+	func(&tasks[0]);
+	for(t=1;t<threads;++t) {
+		if(started[t])
+			pthread_join(pth[t],NULL);
+	}
+#else
+	(void)threads;
+	func(&tasks[0]);
+#endif
+}
+
+static inline size_t buildbucket(jwHashBuild *build, jwHashPair *pair)
+{
+	if(build->keytag==HASHKEYSTR)
+		return hashString(pair->key.strValue) % build->table->buckets;
+	return hashInt(pair->key.intValue) % build->table->buckets;
+}
+
+static inline size_t buildbytes(jwHashBuild *build, jwHashPair *pair)
+{
+	size_t bytes = 0;
+	if(build->keytag==HASHKEYSTR)
+		bytes += strlen(pair->key.strValue)+1;
+	if(pair->valtag==HASHSTRING)
+		bytes += strlen(pair->value.strValue)+1;
+	return bytes;
+}
+
+// copy a string into the build's string block
+static inline char *buildstring(char **cursor, char *value)
+{
+	char *copy = *cursor;
+	size_t len = strlen(value)+1;
+	memcpy(copy,value,len);
+	*cursor += len;
+	return copy;
+}
+
+// phase 1: hash this thread's slice of pairs, count pairs and bytes per partition
+static void *buildcount(void *arg)
+{
+	jwHashBuildTask *task = (jwHashBuildTask *)arg;
+	jwHashBuild *build = task->build;
+	size_t counts[HASHBUILDTHREADS] = {0};
+	size_t bytes[HASHBUILDTHREADS] = {0};
+	size_t i = build->count*task->id/build->threads;
+	size_t end = build->count*(task->id+1)/build->threads;
+	int p;
+	for(;i<end;++i) {
+		size_t hash = buildbucket(build,&build->pairs[i]);
+		size_t part = hash / build->perpart;
+		build->hashes[i] = hash;
+		counts[part]++;
+		bytes[part] += buildbytes(build,&build->pairs[i]);
+	}
+	for(p=0;p<build->threads;++p) {
+		build->counts[task->id*build->threads+p] = counts[p];
+		build->bytes[task->id*build->threads+p] = bytes[p];
+	}
+	return NULL;
+}
+
+// phase 2: scatter this thread's slice of pair indices into their partitions
+static void *buildscatter(void *arg)
+{
+	jwHashBuildTask *task = (jwHashBuildTask *)arg;
+	jwHashBuild *build = task->build;
+	size_t *offsets = build->counts + task->id*build->threads;
+	size_t i = build->count*task->id/build->threads;
+	size_t end = build->count*(task->id+1)/build->threads;
+	for(;i<end;++i)
+		build->order[offsets[build->hashes[i]/build->perpart]++] = i;
+	return NULL;
+}
+
+// phase 3: lay out one partition's entries grouped by bucket, then link chains
+static void *buildplace(void *arg)
+{
+	jwHashBuildTask *task = (jwHashBuildTask *)arg;
+	jwHashBuild *build = task->build;
+	jwHashTable *table = build->table;
+	int part = task->id;
+	size_t first = part*build->perpart;
+	size_t last = first+build->perpart;
+	size_t begin = build->partstart[part];
+	size_t end = build->partstart[part+1];
+	jwHashEntry *entries = table->entries + begin;
+	char *str = table->strings + build->partstring[part];
+	size_t *start, *fill;
+	size_t nb, b, k, j;
+
+	build->freehead[part] = build->freetail[part] = NULL;
+	if(last>table->buckets)
+		last = table->buckets;
+	if(first>=last)
+		return NULL;
+	nb = last-first;
+	start = (size_t *)calloc(nb+1,sizeof(size_t));
+	fill = (size_t *)malloc(nb*sizeof(size_t));
+	if(!start || !fill) {
+		printf("Unable to allocate build partition\n");
+		abort();
+	}
+
+	// count then prefix sum to get each bucket's run of slots
+	for(k=begin;k<end;++k)
+		start[build->hashes[build->order[k]]-first+1]++;
+	for(b=0;b<nb;++b) {
+		start[b+1] += start[b];
+		fill[b] = start[b];
+	}
+
+	// place entries, pairs keep their input order so a later duplicate wins
+	for(k=begin;k<end;++k) {
+		jwHashPair *pair = &build->pairs[build->order[k]];
+		jwHashEntry *entry = NULL;
+		b = build->hashes[build->order[k]]-first;
+		if(!(build->flags & HASHBUILDUNIQUE)) {
+			for(j=start[b];j<fill[b];++j) {
+				if(build->keytag==HASHKEYSTR ?
+				   0==strcmp(entries[j].key.strValue,pair->key.strValue) :
+				   entries[j].key.intValue==pair->key.intValue) {
+					entry = &entries[j];
+					break;
+				}
+			}
+		}
+		if(!entry) {
+			entry = &entries[fill[b]++];
+			entry->keytag = build->keytag;
+			if(build->keytag==HASHKEYSTR)
+				entry->key.strValue = buildstring(&str,pair->key.strValue);
+			else
+				entry->key.intValue = pair->key.intValue;
+		}
+		entry->valtag = pair->valtag;
+		if(pair->valtag==HASHSTRING)
+			entry->value.strValue = buildstring(&str,pair->value.strValue);
+		else
+			memcpy(&entry->value,&pair->value,sizeof(entry->value));
+	}
+
+	// link each bucket's run, and collect slots left over from duplicates
+	for(b=0;b<nb;++b) {
+		table->bucket[first+b] = fill[b]>start[b] ? &entries[start[b]] : NULL;
+		for(j=start[b];j<fill[b];++j)
+			entries[j].next = j+1<fill[b] ? &entries[j+1] : NULL;
+		for(j=fill[b];j<start[b+1];++j) {
+			entries[j].next = build->freehead[part];
+			if(!build->freehead[part])
+				build->freetail[part] = &entries[j];
+			build->freehead[part] = &entries[j];
+		}
+	}
+	free(start);
+	free(fill);
+	return NULL;
+}
+
+// Create a table with one bucket per pair and load all pairs
+jwHashTable *build_hash_from_array( jwHashPair *pairs, size_t count, HASHKEYTAG keytag, int flags )
+{
+	jwHashBuild build;
+	jwHashBuildTask tasks[HASHBUILDTHREADS];
+	size_t pos, bytes;
+	int p, t;
+
+	jwHashTable *table = create_hash(count ? count : 1);
+	if(!table)
+		return NULL;
+	memset(&build,0,sizeof(build));
+	build.table = table;
+	build.pairs = pairs;
+	build.count = count;
+	build.keytag = keytag;
+	build.flags = flags;
+	build.threads = buildthreads(count);
+	build.perpart = (table->buckets+build.threads-1)/build.threads;
+	for(t=0;t<build.threads;++t) {
+		tasks[t].build = &build;
+		tasks[t].id = t;
+	}
+
+	table->entries = (jwHashEntry *)malloc((count ? count : 1)*sizeof(jwHashEntry));
+	table->entrycount = count;
+	build.hashes = (size_t *)malloc((count ? count : 1)*sizeof(size_t));
+	build.order = (size_t *)malloc((count ? count : 1)*sizeof(size_t));
+	build.counts = (size_t *)malloc(build.threads*build.threads*sizeof(size_t));
+	build.bytes = (size_t *)malloc(build.threads*build.threads*sizeof(size_t));
+	if(!table->entries || !build.hashes || !build.order || !build.counts || !build.bytes)
+		goto fail;
+
+	buildrun(buildcount,tasks,build.threads);
+
+	// turn per-thread counts into scatter offsets, partitions in bucket order
+	pos = bytes = 0;
+	for(p=0;p<build.threads;++p) {
+		build.partstart[p] = pos;
+		build.partstring[p] = bytes;
+		for(t=0;t<build.threads;++t) {
+			size_t c = build.counts[t*build.threads+p];
+			build.counts[t*build.threads+p] = pos;
+			pos += c;
+			bytes += build.bytes[t*build.threads+p];
+		}
+	}
+	build.partstart[build.threads] = pos;
+	build.partstring[build.threads] = bytes;
+	table->strings = (char *)malloc(bytes ? bytes : 1);
+	table->stringsize = bytes;
+	if(!table->strings)
+		goto fail;
+
+	buildrun(buildscatter,tasks,build.threads);
+	buildrun(buildplace,tasks,build.threads);
+
+	// unused slots become the table's freelist
+	for(p=build.threads-1;p>=0;--p) {
+		if(build.freehead[p]) {
+			build.freetail[p]->next = table->freelist;
+			table->freelist = build.freehead[p];
+		}
+	}
+	free(build.hashes);
+	free(build.order);
+	free(build.counts);
+	free(build.bytes);
+	return table;
+
+fail:
+	free(build.hashes);
+	free(build.order);
+	free(build.counts);
+	free(build.bytes);
+	// nothing is linked into the buckets yet
+	return delete_hash(table);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// NEGATIVE LOOKUP FILTER
+
+// Blocked Bloom filter: each key sets one bit in each of the 8 words of a
+// single 64 byte block, so a lookup touches one cache line. The 8 probes are
+// independent and branch free, which lets the compiler vectorize them.
+// http://algo2.iti.kit.edu/documents/cacheefficientbloomfilters-jea.pdf
+// Bits can't be cleared, keys deleted since the last enable_filter are
+// counted as stale and only cost false positives until it is called again.
+// Lookup counters and miss timings are only kept after enable_filter_stats,
+// so readers don't all write to the filter's cache line by default.
+
+#define HASHFILTERWORDS		8			// 64 bit words per block, one cache line
+
+struct jwHashFilter
+{
+	unsigned long long *blocks;		// nblocks * HASHFILTERWORDS words
+	size_t nblocks;
+	size_t capacity;				// keys the filter was sized for
+	size_t keys;					// keys added, including stale ones
+	size_t stale;					// keys deleted since the filter was built
+	int counting;					// set by enable_filter_stats
+	size_t lookups;
+	size_t rejected;
+	size_t falsepositives;
+	size_t missnanos;				// time spent in get_* misses that were timed
+	size_t timedmisses;
+};
+
+// counters may be bumped by several threads at once
+static inline void filtercount(size_t *counter, size_t n)
+{
+#ifdef HASHTHREADED
+	__sync_fetch_and_add(counter,n);
+#else
+	*counter += n;
+#endif
+}
+
+static inline size_t filterclock(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return (size_t)now.tv_sec*1000000000+now.tv_nsec;
+}
+
+// odd constants picking each word's bit, from the split block filter in Impala/Parquet
+static const unsigned int filtersalt[HASHFILTERWORDS] = {
+	0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+	0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+static inline unsigned long long *filterblock(jwHashFilter *filter, unsigned long long mixed)
+{
+	return filter->blocks + hashrange(mixed,filter->nblocks)*HASHFILTERWORDS;
+}
+
+static inline void filtermask(unsigned int bits, unsigned long long *mask)
+{
+	int w;
+	for(w=0;w<HASHFILTERWORDS;++w)
+		mask[w] = 1ULL << ((bits*filtersalt[w]) >> 26);
+}
+
+static inline void filteradd(jwHashFilter *filter, long int keyhash)
+{
+	unsigned long long mixed = mix64(keyhash);
+	unsigned long long *block = filterblock(filter,mixed);
+	unsigned long long mask[HASHFILTERWORDS];
+	int w;
+	filtermask((unsigned int)mixed,mask);
+	for(w=0;w<HASHFILTERWORDS;++w) {
+#ifdef HASHTHREADED
+		__sync_fetch_and_or(&block[w],mask[w]);
+#else
+		block[w] |= mask[w];
+#endif
+	}
+	filtercount(&filter->keys,1);
+}
+
+// 0 if the key is definitely not in the table. When counting, *started is set
+// so a miss found later in the chain can be timed with filtermiss.
+static inline int filtertest(jwHashFilter *filter, long int keyhash, size_t *started)
+{
+	unsigned long long mixed = mix64(keyhash);
+	unsigned long long *block = filterblock(filter,mixed);
+	unsigned long long mask[HASHFILTERWORDS];
+	unsigned long long missing = 0;
+	int w;
+	filtermask((unsigned int)mixed,mask);
+	if(filter->counting)
+		*started = filterclock();
+	for(w=0;w<HASHFILTERWORDS;++w)
+		missing |= mask[w] & ~block[w];
+	if(filter->counting) {
+		filtercount(&filter->lookups,1);
+		if(missing) {
+			filtercount(&filter->rejected,1);
+			filtercount(&filter->missnanos,filterclock()-*started);
+			filtercount(&filter->timedmisses,1);
+		}
+	}
+	return !missing;
+}
+
+// a key that got past the filter wasn't in the table, started is 0 if untimed
+static inline void filtermiss(jwHashFilter *filter, size_t started)
+{
+	if(!filter->counting)
+		return;
+	filtercount(&filter->falsepositives,1);
+	if(started) {
+		filtercount(&filter->missnanos,filterclock()-started);
+		filtercount(&filter->timedmisses,1);
+	}
+}
+
+static void freefilter( jwHashFilter *filter )
+{
+	if(!filter)
+		return;
+	free(filter->blocks);
+	free(filter);
+}
+
+// Add a filter sized for keys at bitsperkey, or rebuild the current one.
+// Not safe to call while other threads use the table.
+HASHRESULT enable_filter( jwHashTable *table, size_t keys, int bitsperkey )
+{
+	jwHashFilter *filter;
+	jwHashEntry *entry;
+	size_t b;
+	void *blocks;
+
+	if(table->shared)
+		return HASHSHARED;
+	if(table->frozen)
+		return HASHFROZEN;
+	if(bitsperkey<1)
+		bitsperkey = 1;
+	filter = (jwHashFilter *)calloc(1,sizeof(jwHashFilter));
+	if(!filter)
+		return HASHNOTFOUND;
+	filter->capacity = keys;
+	filter->nblocks = (keys*bitsperkey+HASHFILTERWORDS*64-1)/(HASHFILTERWORDS*64);
+	if(!filter->nblocks)
+		filter->nblocks = 1;
+	if(posix_memalign(&blocks,HASHFILTERWORDS*sizeof(unsigned long long),
+	                  filter->nblocks*HASHFILTERWORDS*sizeof(unsigned long long))) {
+		free(filter);
+		return HASHNOTFOUND;
+	}
+	filter->blocks = (unsigned long long *)blocks;
+	memset(filter->blocks,0,filter->nblocks*HASHFILTERWORDS*sizeof(unsigned long long));
+
+	// add keys already in the table
+	for(b=0;b<table->buckets;++b) {
+		for(entry=table->bucket[b];entry;entry=entry->next) {
+			if(entry->keytag==HASHKEYSTR)
+				filteradd(filter,hashString(entry->key.strValue));
+			else
+				filteradd(filter,hashInt(entry->key.intValue));
+		}
+	}
+	if(table->filter)
+		filter->counting = table->filter->counting;
+	freefilter(table->filter);
+	table->filter = filter;
+	return HASHOK;
+}
+
+// Start counting lookups and timing misses, which costs every get_* a few
+// atomic adds and clock reads. Counts restart when the filter is rebuilt.
+HASHRESULT enable_filter_stats( jwHashTable *table )
+{
+	if(!table->filter)
+		return HASHNOTFOUND;
+	table->filter->counting = 1;
+	return HASHOK;
+}
+
+// Remove the filter, lookups go straight to the buckets again
+HASHRESULT disable_filter( jwHashTable *table )
+{
+	if(!table->filter)
+		return HASHNOTFOUND;
+	freefilter(table->filter);
+	table->filter = NULL;
+	return HASHOK;
+}
+
+// Filter counters, lookups and timings are 0 unless enable_filter_stats was called
+HASHRESULT get_filter_stats( jwHashTable *table, jwHashFilterStats *stats )
+{
+	jwHashFilter *filter = table->filter;
+	size_t misses;
+	if(!filter)
+		return HASHNOTFOUND;
+	stats->bytes = filter->nblocks*HASHFILTERWORDS*sizeof(unsigned long long);
+	stats->capacity = filter->capacity;
+	stats->keys = filter->keys;
+	stats->stale = filter->stale;
+	stats->lookups = filter->lookups;
+	stats->rejected = filter->rejected;
+	stats->falsepositives = filter->falsepositives;
+	misses = filter->rejected+filter->falsepositives;
+	stats->fprate = misses ? (double)filter->falsepositives/misses : 0.0;
+	stats->missns = filter->timedmisses ? (double)filter->missnanos/filter->timedmisses : 0.0;
+	return HASHOK;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// FROZEN TABLES
+
+// A frozen table is a minimal perfect hash over the table's keys. Keys are
+// split into small groups and each group stores the displacement that sends
+// all of its keys to distinct slots, so a lookup is one probe into a flat
+// array of slots and one key compare.
+// http://cmph.sourceforge.net/papers/esa09.pdf (CHD, hash and displace)
+
+#define HASHFROZENGROUP		4			// average keys per displacement group
+#define HASHFROZENSEEDS		8			// global seeds to try before giving up
+#define HASHFROZENMAGIC		"jwHashF2"
+
+typedef struct jwHashSlot jwHashSlot;
+struct jwHashSlot
+{
+	union
+	{
+		char  *strValue;
+		double dblValue;
+		int	   intValue;
+	} key;
+	HASHVALTAG valtag;
+	HASHKEYTAG keytag;
+	union
+	{
+		char  *strValue;
+		double dblValue;
+		int	   intValue;
+		void  *ptrValue;
+	} value;
+};
+
+struct jwHashFrozen
+{
+	size_t count;					// keys, and slots
+	size_t groups;
+	unsigned long long seed;		// global hash seed
+	unsigned int *displace;			// displacement per group
+	jwHashSlot *slots;
+	char *strings;					// all key and value strings
+	size_t stringsize;
+	long int *multi;				// each multi value run, preceded by its count
+	size_t multisize;
+};
+
+static inline unsigned long long frozenhash_str(jwHashFrozen *frozen, char *key)
+{
+	return hashString64(key,frozen->seed);
+}
+
+// mix64 is a bijection, so int keys can't collide
+static inline unsigned long long frozenhash_int(jwHashFrozen *frozen, long int key)
+{
+	return mix64((unsigned long long)key + frozen->seed);
+}
+
+static inline size_t frozengroup(jwHashFrozen *frozen, unsigned long long hash)
+{
+	return hashrange(hash,frozen->groups);
+}
+
+static inline size_t frozenslot(jwHashFrozen *frozen, unsigned long long hash, unsigned int displace)
+{
+	return hashrange(mix64(hash ^ (displace*0x9e3779b97f4a7c15ULL)),frozen->count);
+}
+
+static inline jwHashSlot *frozenfind_str(jwHashFrozen *frozen, char *key)
+{
+	unsigned long long hash;
+	jwHashSlot *slot;
+	if(!frozen->count)
+		return NULL;
+	hash = frozenhash_str(frozen,key);
+	slot = &frozen->slots[frozenslot(frozen,hash,frozen->displace[frozengroup(frozen,hash)])];
+	if(slot->keytag==HASHKEYSTR && 0==strcmp(slot->key.strValue,key))
+		return slot;
+	return NULL;
+}
+
+static inline jwHashSlot *frozenfind_int(jwHashFrozen *frozen, long int key)
+{
+	unsigned long long hash;
+	jwHashSlot *slot;
+	if(!frozen->count)
+		return NULL;
+	hash = frozenhash_int(frozen,key);
+	slot = &frozen->slots[frozenslot(frozen,hash,frozen->displace[frozengroup(frozen,hash)])];
+	if(slot->keytag==HASHKEYINT && slot->key.intValue==key)
+		return slot;
+	return NULL;
+}
+
+static void freefrozen( jwHashFrozen *frozen )
+{
+	if(!frozen)
+		return;
+	free(frozen->displace);
+	free(frozen->slots);
+	free(frozen->strings);
+	free(frozen->multi);
+	free(frozen);
+}
+
+// find a displacement for every group, largest groups first while slots are free
+// returns 0 and the slot for each key, or 1 if some group can't be placed
+static int frozenplace(jwHashFrozen *frozen, unsigned long long *hashes, size_t *slotof)
+{
+	size_t n = frozen->count, groups = frozen->groups;
+	size_t *start = (size_t *)calloc(groups+1,sizeof(size_t));
+	size_t *member = (size_t *)malloc(n*sizeof(size_t));
+	size_t *bysize = (size_t *)malloc(groups*sizeof(size_t));
+	char *taken = (char *)calloc(n,1);
+	size_t maxsize = 0, *sizes, *fill, g, i, k, j;
+	unsigned long long limit = 16ULL*n+1024;
+	int failed = 0;
+	if(!start || !member || !bysize || !taken) {
+		printf("Unable to allocate frozen table\n");
+		abort();
+	}
+
+	// group members, stored contiguously per group
+	for(i=0;i<n;++i)
+		start[frozengroup(frozen,hashes[i])+1]++;
+	for(g=0;g<groups;++g) {
+		if(start[g+1]>maxsize)
+			maxsize = start[g+1];
+		start[g+1] += start[g];
+	}
+	fill = (size_t *)malloc(groups*sizeof(size_t));
+	sizes = (size_t *)calloc(maxsize+2,sizeof(size_t));
+	if(!fill || !sizes) {
+		printf("Unable to allocate frozen table\n");
+		abort();
+	}
+	memcpy(fill,start,groups*sizeof(size_t));
+	for(i=0;i<n;++i)
+		member[fill[frozengroup(frozen,hashes[i])]++] = i;
+
+	// order groups by size, largest first
+	for(g=0;g<groups;++g)
+		sizes[maxsize-(start[g+1]-start[g])+1]++;
+	for(k=0;k<=maxsize;++k)
+		sizes[k+1] += sizes[k];
+	for(g=0;g<groups;++g)
+		bysize[sizes[maxsize-(start[g+1]-start[g])]++] = g;
+
+	for(k=0;k<groups && !failed;++k) {
+		size_t first, last;
+		unsigned long long d;
+		g = bysize[k];
+		first = start[g];
+		last = start[g+1];
+		frozen->displace[g] = 0;
+		if(first==last)
+			continue;
+		for(d=0;d<limit;++d) {
+			for(i=first;i<last;++i) {
+				size_t slot = frozenslot(frozen,hashes[member[i]],(unsigned int)d);
+				if(taken[slot])
+					break;
+				for(j=first;j<i;++j)
+					if(slotof[member[j]]==slot)
+						break;
+				if(j<i)
+					break;
+				slotof[member[i]] = slot;
+			}
+			if(i==last)
+				break;
+		}
+		if(d==limit) {
+			failed = 1;
+			break;
+		}
+		frozen->displace[g] = (unsigned int)d;
+		for(i=first;i<last;++i)
+			taken[slotof[member[i]]] = 1;
+	}
+	free(start);
+	free(member);
+	free(bysize);
+	free(taken);
+	free(fill);
+	free(sizes);
+	return failed;
+}
+
+// Convert to a read-only minimal perfect hash, get_* still work
+// Not safe to call while other threads use the table.
+HASHRESULT freeze_hash( jwHashTable *table )
+{
+	jwHashFrozen *frozen;
+	jwHashEntry **entries, *entry;
+	unsigned long long *hashes;
+	size_t *slotof;
+	size_t n = 0, bytes = 0, multis = 0, b, i;
+	long int *multi;
+	char *str;
+	int seed;
+
+	if(table->shared)
+		return HASHSHARED;
+	if(table->frozen)
+		return HASHFROZEN;
+	for(b=0;b<table->buckets;++b) {
+		for(entry=table->bucket[b];entry;entry=entry->next) {
+			++n;
+			if(entry->keytag==HASHKEYSTR)
+				bytes += strlen(entry->key.strValue)+1;
+			if(entry->valtag==HASHSTRING || entry->valtag==HASHPACKED)
+				bytes += stringlength(entry);
+			if(entry->valtag==HASHMULTI)
+				multis += ((jwHashMulti *)entry)->count+1;
+		}
+	}
+
+	frozen = (jwHashFrozen *)calloc(1,sizeof(jwHashFrozen));
+	if(!frozen) {
+		printf("Unable to allocate frozen table\n");
+		abort();
+	}
+	frozen->count = n;
+	frozen->groups = n/HASHFROZENGROUP+1;
+	frozen->displace = (unsigned int *)calloc(frozen->groups,sizeof(unsigned int));
+	frozen->slots = (jwHashSlot *)malloc((n ? n : 1)*sizeof(jwHashSlot));
+	frozen->strings = (char *)malloc(bytes ? bytes : 1);
+	frozen->stringsize = bytes;
+	frozen->multi = (long int *)malloc((multis ? multis : 1)*sizeof(long int));
+	frozen->multisize = multis;
+	entries = (jwHashEntry **)malloc((n ? n : 1)*sizeof(jwHashEntry *));
+	hashes = (unsigned long long *)malloc((n ? n : 1)*sizeof(unsigned long long));
+	slotof = (size_t *)malloc((n ? n : 1)*sizeof(size_t));
+	if(!frozen->displace || !frozen->slots || !frozen->strings || !frozen->multi || !entries || !hashes || !slotof) {
+		printf("Unable to allocate frozen table\n");
+		abort();
+	}
+	i = 0;
+	for(b=0;b<table->buckets;++b)
+		for(entry=table->bucket[b];entry;entry=entry->next)
+			entries[i++] = entry;
+
+	// a bad global seed only shows up as a group that can't be placed, so try another
+	for(seed=0;seed<HASHFROZENSEEDS;++seed) {
+		frozen->seed = mix64(seed+1);
+		for(i=0;i<n;++i) {
+			if(entries[i]->keytag==HASHKEYSTR)
+				hashes[i] = frozenhash_str(frozen,entries[i]->key.strValue);
+			else
+				hashes[i] = frozenhash_int(frozen,entries[i]->key.intValue);
+		}
+		if(0==frozenplace(frozen,hashes,slotof))
+			break;
+	}
+	if(seed==HASHFROZENSEEDS) {
+		// table is left as it was
+		free(entries);
+		free(hashes);
+		free(slotof);
+		freefrozen(frozen);
+		return HASHFREEZEFAILED;
+	}
+
+	// pack slots, strings and multi values
+	str = frozen->strings;
+	multi = frozen->multi;
+	for(i=0;i<n;++i) {
+		jwHashSlot *slot = &frozen->slots[slotof[i]];
+		entry = entries[i];
+		slot->keytag = entry->keytag;
+		slot->valtag = entry->valtag;
+		memcpy(&slot->key,&entry->key,sizeof(slot->key));
+		memcpy(&slot->value,&entry->value,sizeof(slot->value));
+		if(entry->keytag==HASHKEYSTR) {
+			slot->key.strValue = str;
+			strcpy(str,entry->key.strValue);
+			str += strlen(str)+1;
+		}
+		// compressed values are unpacked, frozen strings are packed together instead
+		if(entry->valtag==HASHSTRING || entry->valtag==HASHPACKED) {
+			slot->valtag = HASHSTRING;
+			slot->value.strValue = str;
+			copyvalue(table,entry,str);
+			str += strlen(str)+1;
+		}
+		if(entry->valtag==HASHMULTI) {
+			jwHashMulti *values = (jwHashMulti *)entry;
+			*multi++ = (long int)values->count;
+			slot->value.ptrValue = multi;
+			memcpy(multi,values->values,values->count*sizeof(long int));
+			multi += values->count;
+		}
+	}
+	free(entries);
+	free(hashes);
+	free(slotof);
+
+	// drop the chained form, and the filter since a frozen lookup is one probe anyway
+	clearentries(table);
+	freefilter(table->filter);
+	table->filter = NULL;
+	freecompress(table->compress);
+	table->compress = NULL;
+	freeindex(table->index);
+	table->index = NULL;
+	freebuckets(table);
+	table->frozen = frozen;
+	return HASHOK;
+}
+
+// Save a frozen table. String pointers are written as offsets into the string
+// block, pointer values are written as-is and only make sense to this process.
+HASHRESULT save_frozen_hash( jwHashTable *table, const char *path )
+{
+	jwHashFrozen *frozen = table->frozen;
+	unsigned long long header[6];
+	size_t i;
+	int ok;
+	FILE *file;
+
+	if(!frozen)
+		return HASHNOTFOUND;
+	file = fopen(path,"wb");
+	if(!file)
+		return HASHNOTFOUND;
+	header[0] = frozen->count;
+	header[1] = frozen->groups;
+	header[2] = frozen->seed;
+	header[3] = frozen->stringsize;
+	header[4] = sizeof(jwHashSlot);
+	header[5] = frozen->multisize;
+	ok = 1==fwrite(HASHFROZENMAGIC,8,1,file) &&
+		 1==fwrite(header,sizeof(header),1,file) &&
+		 frozen->groups==fwrite(frozen->displace,sizeof(unsigned int),frozen->groups,file);
+	for(i=0;ok && i<frozen->count;++i) {
+		jwHashSlot slot = frozen->slots[i];
+		if(slot.keytag==HASHKEYSTR)
+			slot.key.strValue = (char *)(slot.key.strValue - frozen->strings);
+		if(slot.valtag==HASHSTRING)
+			slot.value.strValue = (char *)(slot.value.strValue - frozen->strings);
+		if(slot.valtag==HASHMULTI)
+			slot.value.ptrValue = (void *)((long int *)slot.value.ptrValue - frozen->multi);
+		ok = 1==fwrite(&slot,sizeof(slot),1,file);
+	}
+	ok = ok && frozen->stringsize==fwrite(frozen->strings,1,frozen->stringsize,file);
+	ok = ok && frozen->multisize==fwrite(frozen->multi,sizeof(long int),frozen->multisize,file);
+	ok = 0==fclose(file) && ok;
+	return ok ? HASHOK : HASHNOTFOUND;
+}
+
+// add count blocks of size bytes to *total, 0 if that overflows
+static inline int frozenbytes(unsigned long long *total, unsigned long long count, size_t size)
+{
+	if(count > (~0ULL - *total) / size)
+		return 0;
+	*total += count*size;
+	return 1;
+}
+
+// check a saved header against the file's length before trusting any of it
+static int frozenheader(unsigned long long *header, FILE *file)
+{
+	unsigned long long total = 8 + 6*sizeof(unsigned long long);
+	long end, at = ftell(file);
+	if(header[4]!=sizeof(jwHashSlot) || (header[0] && !header[1]) || header[1] > header[0] + 1 ||
+	   header[0] > (size_t)-1 / sizeof(jwHashSlot) || header[5] > (size_t)-1 / sizeof(long int))
+		return 0;
+	if(!frozenbytes(&total,header[1],sizeof(unsigned int)) || !frozenbytes(&total,header[0],sizeof(jwHashSlot)) ||
+	   !frozenbytes(&total,header[3],1) || !frozenbytes(&total,header[5],sizeof(long int)))
+		return 0;
+	if(at<0 || fseek(file,0,SEEK_END) || (end = ftell(file))<0 || fseek(file,at,SEEK_SET))
+		return 0;
+	return total==(unsigned long long)end;
+}
+
+// Load a table saved by save_frozen_hash, on the same architecture. The header
+// is checked against the file's length and every offset against its block, so
+// a truncated or corrupt file gives NULL rather than a table that reads wild.
+jwHashTable *load_frozen_hash( const char *path )
+{
+	jwHashFrozen *frozen;
+	jwHashTable *table;
+	unsigned long long header[6];
+	char magic[8];
+	size_t i;
+	int ok;
+	FILE *file = fopen(path,"rb");
+
+	if(!file)
+		return NULL;
+	if(1!=fread(magic,8,1,file) || memcmp(magic,HASHFROZENMAGIC,8) ||
+	   1!=fread(header,sizeof(header),1,file) || !frozenheader(header,file)) {
+		fclose(file);
+		return NULL;
+	}
+	frozen = (jwHashFrozen *)calloc(1,sizeof(jwHashFrozen));
+	if(!frozen) {
+		fclose(file);
+		return NULL;
+	}
+	frozen->count = header[0];
+	frozen->groups = header[1];
+	frozen->seed = header[2];
+	frozen->stringsize = header[3];
+	frozen->multisize = header[5];
+	frozen->displace = (unsigned int *)malloc(frozen->groups*sizeof(unsigned int));
+	frozen->slots = (jwHashSlot *)malloc((frozen->count ? frozen->count : 1)*sizeof(jwHashSlot));
+	frozen->strings = (char *)malloc(frozen->stringsize ? frozen->stringsize : 1);
+	frozen->multi = (long int *)malloc((frozen->multisize ? frozen->multisize : 1)*sizeof(long int));
+	ok = frozen->displace && frozen->slots && frozen->strings && frozen->multi &&
+		 frozen->groups==fread(frozen->displace,sizeof(unsigned int),frozen->groups,file) &&
+		 frozen->count==fread(frozen->slots,sizeof(jwHashSlot),frozen->count,file) &&
+		 frozen->stringsize==fread(frozen->strings,1,frozen->stringsize,file) &&
+		 frozen->multisize==fread(frozen->multi,sizeof(long int),frozen->multisize,file);
+	fclose(file);
+	// every string must end inside the block
+	ok = ok && (!frozen->stringsize || !frozen->strings[frozen->stringsize-1]);
+	for(i=0;ok && i<frozen->count;++i) {
+		jwHashSlot *slot = &frozen->slots[i];
+		ok = slot->keytag==HASHKEYSTR || slot->keytag==HASHKEYINT;
+		if(slot->keytag==HASHKEYSTR) {
+			ok = ok && (size_t)slot->key.strValue < frozen->stringsize;
+			slot->key.strValue = frozen->strings + (size_t)slot->key.strValue;
+		}
+		if(slot->valtag==HASHSTRING) {
+			ok = ok && (size_t)slot->value.strValue < frozen->stringsize;
+			slot->value.strValue = frozen->strings + (size_t)slot->value.strValue;
+		}
+		if(slot->valtag==HASHMULTI) {
+			// the count sits just before the values, and must fit in what's left of the block
+			size_t at = (size_t)slot->value.ptrValue;
+			ok = ok && at >= 1 && at <= frozen->multisize && frozen->multi[at-1] >= 0 &&
+				 (size_t)frozen->multi[at-1] <= frozen->multisize - at;
+			slot->value.ptrValue = frozen->multi + at;
+		}
+	}
+	table = ok ? create_hash(1) : NULL;
+	if(!table) {
+		freefrozen(frozen);
+		return NULL;
+	}
+	freebuckets(table);
+	table->frozen = frozen;
+	return table;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// INTERLEAVED LOOKUPS
+
+// A stream keeps up to width lookups in flight. Each lookup is a small state
+// machine that prefetches the next thing it needs, a bucket, an entry or a key
+// string, then yields to the next lookup instead of waiting for it, so one
+// lookup's cache misses overlap with the others.
+
+typedef enum
+{
+	STREAMFREE,
+	STREAMBUCKET,					// bucket head prefetched
+	STREAMENTRY,					// entry prefetched
+	STREAMKEY,						// entry's key string prefetched
+	STREAMFROZENSLOT,				// frozen slot prefetched
+	STREAMFROZENKEY,				// frozen slot's key string prefetched
+	STREAMDONE,
+} STREAMSTATE;
+
+typedef struct jwHashLookup jwHashLookup;
+struct jwHashLookup
+{
+	STREAMSTATE state;
+	HASHKEYTAG keytag;
+	union
+	{
+		char  *strValue;
+		long int intValue;
+	} key;
+	void *tag;
+	jwHashEntry **bucket;
+	jwHashEntry *entry;
+	jwHashSlot *slot;				// frozen tables
+	int found;
+};
+
+struct jwHashStream
+{
+	jwHashTable *table;
+	int width;
+	int active;						// lookups not yet returned by stream_next
+	int next;						// round robin position
+	int *free;						// stack of free lookups
+	int freecount;
+	jwHashLookup *lookups;
+};
+
+// Create a stream that interleaves up to width lookups on table
+jwHashStream *create_stream( jwHashTable *table, int width )
+{
+	jwHashStream *stream;
+	int i;
+	if(table->shared)
+		return NULL;
+	if(width<1)
+		width = 1;
+	stream = (jwHashStream *)malloc(sizeof(jwHashStream));
+	if(!stream)
+		return NULL;
+	stream->lookups = (jwHashLookup *)calloc(width,sizeof(jwHashLookup));
+	stream->free = (int *)malloc(width*sizeof(int));
+	if(!stream->lookups || !stream->free) {
+		free(stream->lookups);
+		free(stream->free);
+		free(stream);
+		return NULL;
+	}
+	stream->table = table;
+	stream->width = width;
+	stream->active = stream->next = 0;
+	for(i=0;i<width;++i)
+		stream->free[i] = width-1-i;
+	stream->freecount = width;
+	return stream;
+}
+
+void *delete_stream( jwHashStream *stream )
+{
+	free(stream->lookups);
+	free(stream->free);
+	free(stream);
+	return NULL;
+}
+
+// finish a lookup that ran off the end of its chain
+static inline void streammiss(jwHashStream *stream, jwHashLookup *lookup)
+{
+	if(stream->table->filter)
+		filtermiss(stream->table->filter,0);
+	lookup->found = 0;
+	lookup->state = STREAMDONE;
+}
+
+// move to the next entry in the chain, prefetching it
+static inline void streamnext(jwHashStream *stream, jwHashLookup *lookup)
+{
+	lookup->entry = lookup->entry->next;
+	if(!lookup->entry) {
+		streammiss(stream,lookup);
+		return;
+	}
+	__builtin_prefetch(lookup->entry);
+	lookup->state = STREAMENTRY;
+}
+
+// advance one lookup by one memory access
+static inline void streamstep(jwHashStream *stream, jwHashLookup *lookup)
+{
+	switch(lookup->state)
+	{
+	case STREAMBUCKET:
+		lookup->entry = *lookup->bucket;
+		if(!lookup->entry) {
+			streammiss(stream,lookup);
+			break;
+		}
+		__builtin_prefetch(lookup->entry);
+		lookup->state = STREAMENTRY;
+		break;
+	case STREAMENTRY:
+		if(lookup->entry->keytag!=lookup->keytag) {
+			streamnext(stream,lookup);
+		} else if(lookup->keytag==HASHKEYSTR) {
+			__builtin_prefetch(lookup->entry->key.strValue);
+			lookup->state = STREAMKEY;
+		} else if(lookup->entry->key.intValue==lookup->key.intValue) {
+			lookup->found = 1;
+			lookup->state = STREAMDONE;
+		} else {
+			streamnext(stream,lookup);
+		}
+		break;
+	case STREAMKEY:
+		if(0==strcmp(lookup->entry->key.strValue,lookup->key.strValue)) {
+			lookup->found = 1;
+			lookup->state = STREAMDONE;
+		} else {
+			streamnext(stream,lookup);
+		}
+		break;
+	case STREAMFROZENSLOT:
+		lookup->found = 0;
+		lookup->state = STREAMDONE;
+		if(lookup->slot->keytag!=lookup->keytag)
+			break;
+		if(lookup->keytag==HASHKEYINT) {
+			lookup->found = lookup->slot->key.intValue==lookup->key.intValue;
+			break;
+		}
+		__builtin_prefetch(lookup->slot->key.strValue);
+		lookup->state = STREAMFROZENKEY;
+		break;
+	case STREAMFROZENKEY:
+		lookup->found = 0==strcmp(lookup->slot->key.strValue,lookup->key.strValue);
+		lookup->state = STREAMDONE;
+		break;
+	default:
+		break;
+	}
+}
+
+// start a lookup in a free slot, hashing and prefetching its bucket or frozen slot
+static void streamstart(jwHashStream *stream, jwHashLookup *lookup, long int keyhash)
+{
+	jwHashTable *table = stream->table;
+	if(table->frozen) {
+		jwHashFrozen *frozen = table->frozen;
+		unsigned long long hash;
+		if(!frozen->count) {
+			lookup->found = 0;
+			lookup->state = STREAMDONE;
+			return;
+		}
+		if(lookup->keytag==HASHKEYSTR)
+			hash = frozenhash_str(frozen,lookup->key.strValue);
+		else
+			hash = frozenhash_int(frozen,lookup->key.intValue);
+		lookup->slot = &frozen->slots[frozenslot(frozen,hash,frozen->displace[frozengroup(frozen,hash)])];
+		__builtin_prefetch(lookup->slot);
+		lookup->state = STREAMFROZENSLOT;
+		return;
+	}
+	size_t started;
+	if(table->filter && !filtertest(table->filter,keyhash,&started)) {
+		lookup->found = 0;
+		lookup->state = STREAMDONE;
+		return;
+	}
+	lookup->bucket = &table->bucket[keyhash % table->buckets];
+	__builtin_prefetch(lookup->bucket);
+	lookup->state = STREAMBUCKET;
+}
+
+// take a free lookup, or NULL if width lookups are already in flight
+static inline jwHashLookup *streamtake(jwHashStream *stream, void *tag)
+{
+	jwHashLookup *lookup;
+	if(!stream->freecount)
+		return NULL;
+	lookup = &stream->lookups[stream->free[--stream->freecount]];
+	lookup->state = STREAMFREE;
+	lookup->tag = tag;
+	stream->active++;
+	return lookup;
+}
+
+// Queue a lookup, 0 if the stream is full and stream_next must be called first
+int stream_feed_str( jwHashStream *stream, char *key, void *tag )
+{
+	jwHashLookup *lookup = streamtake(stream,tag);
+	if(!lookup)
+		return 0;
+	lookup->keytag = HASHKEYSTR;
+	lookup->key.strValue = key;
+	streamstart(stream,lookup,stream->table->frozen ? 0 : hashString(key));
+	return 1;
+}
+
+int stream_feed_int( jwHashStream *stream, long int key, void *tag )
+{
+	jwHashLookup *lookup = streamtake(stream,tag);
+	if(!lookup)
+		return 0;
+	lookup->keytag = HASHKEYINT;
+	lookup->key.intValue = key;
+	streamstart(stream,lookup,stream->table->frozen ? 0 : hashInt(key));
+	return 1;
+}
+
+// Run lookups until one finishes and return it, 0 once nothing is in flight.
+// Results come back in completion order, use the tag to match them up.
+int stream_next( jwHashStream *stream, jwHashStreamResult *result )
+{
+	while(stream->active) {
+		int i = stream->next;
+		jwHashLookup *lookup = &stream->lookups[i];
+		stream->next = i+1<stream->width ? i+1 : 0;
+		if(lookup->state==STREAMFREE)
+			continue;
+		if(lookup->state!=STREAMDONE)
+			streamstep(stream,lookup);
+		if(lookup->state!=STREAMDONE)
+			continue;
+
+		result->tag = lookup->tag;
+		result->result = lookup->found ? HASHOK : HASHNOTFOUND;
+		if(lookup->found && stream->table->frozen) {
+			result->valtag = lookup->slot->valtag;
+			memcpy(&result->value,&lookup->slot->value,sizeof(result->value));
+		} else if(lookup->found) {
+			result->valtag = lookup->entry->valtag;
+			memcpy(&result->value,&lookup->entry->value,sizeof(result->value));
+		}
+		// values the caller can't use as they are, fetch them with get_multi_* or get_strbuf_*
+		if(lookup->found && result->valtag==HASHMULTI)
+			result->result = HASHMULTIPLE;
+		if(lookup->found && result->valtag==HASHPACKED)
+			result->result = HASHCOMPRESSED;
+		lookup->state = STREAMFREE;
+		stream->free[stream->freecount++] = i;
+		stream->active--;
+		return 1;
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// VALUE COMPRESSION
+
+// String values at least HASHLZMINSIZE long are stored LZ77 compressed when
+// that saves space, in an LZ4 style byte format: a token with literal and match
+// lengths, the literals, then a 2 byte offset. Matches may reach back into a
+// dictionary shared by the whole table, as if it came just before each value.
+// https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+
+#define HASHLZMINSIZE	32				// shorter values aren't worth compressing
+#define HASHLZMINMATCH	4
+#define HASHLZWINDOW	65535			// furthest a 2 byte offset reaches
+#define HASHLZBITS		12				// match finder table size
+#define HASHLZSLACK		16				// room a wild copy may overrun
+
+struct jwHashCompress
+{
+	unsigned char *dict;
+	size_t dictlen;
+	int dicthash[1<<HASHLZBITS];	// match finder table primed with the dictionary
+	size_t values;					// values stored compressed
+	size_t rawbytes;				// their size uncompressed
+	size_t storedbytes;				// their size as stored
+	size_t decodedbytes;			// decoded copies kept for get_str_*
+};
+
+// compressed value, pointed to by value.ptrValue with valtag HASHPACKED
+typedef struct jwHashPacked jwHashPacked;
+struct jwHashPacked
+{
+	unsigned int rawlen;			// without the terminator
+	unsigned int packedlen;
+	char *decoded;					// plain copy made by the first get_str_*, or NULL
+	unsigned char data[1];
+};
+
+// bytes ahead of the packed data, without the tail padding sizeof counts
+#define HASHPACKEDHEAD	offsetof(jwHashPacked,data)
+
+// byte at position p of dictionary followed by input
+static inline unsigned char lzbyte(jwHashCompress *c, const unsigned char *in, size_t p)
+{
+	return p<c->dictlen ? c->dict[p] : in[p-c->dictlen];
+}
+
+static inline unsigned int lzhash(jwHashCompress *c, const unsigned char *in, size_t p)
+{
+	unsigned int seq = lzbyte(c,in,p) | lzbyte(c,in,p+1)<<8 | lzbyte(c,in,p+2)<<16 | (unsigned int)lzbyte(c,in,p+3)<<24;
+	return (seq*2654435761U) >> (32-HASHLZBITS);
+}
+
+// write a length continuation, 255s then the remainder
+static inline unsigned char *lzlength(unsigned char *out, size_t len)
+{
+	while(len>=255) {
+		*out++ = 255;
+		len -= 255;
+	}
+	*out++ = (unsigned char)len;
+	return out;
+}
+
+// one sequence: literals from anchor to p, then a match unless this is the last
+static inline unsigned char *lzsequence(jwHashCompress *c, const unsigned char *in, unsigned char *out,
+                                        size_t anchor, size_t p, size_t offset, size_t match)
+{
+	size_t literals = p-anchor;
+	unsigned char *token = out++;
+	*token = (unsigned char)((literals<15 ? literals : 15) << 4);
+	if(literals>=15)
+		out = lzlength(out,literals-15);
+	while(anchor<p)
+		*out++ = lzbyte(c,in,anchor++);
+	if(!match)
+		return out;
+	*out++ = (unsigned char)offset;
+	*out++ = (unsigned char)(offset>>8);
+	match -= HASHLZMINMATCH;
+	*token |= (unsigned char)(match<15 ? match : 15);
+	if(match>=15)
+		out = lzlength(out,match-15);
+	return out;
+}
+
+// compress len bytes into out, 0 if it doesn't come out smaller
+// out has room for len plus the worst case token overhead
+static size_t lzpack(jwHashCompress *c, const unsigned char *in, size_t len, unsigned char *out)
+{
+	int table[1<<HASHLZBITS];
+	size_t base = c->dictlen, end = base+len, p = base, anchor = base;
+	unsigned char *o = out;
+
+	memcpy(table,c->dicthash,sizeof(table));
+	while(p+HASHLZMINMATCH<=end) {
+		unsigned int h = lzhash(c,in,p);
+		long int candidate = table[h];
+		size_t match = 0;
+		table[h] = (int)p;
+		if(candidate>=0 && p-candidate<=HASHLZWINDOW) {
+			while(p+match<end && lzbyte(c,in,candidate+match)==lzbyte(c,in,p+match))
+				++match;
+		}
+		if(match<HASHLZMINMATCH) {
+			++p;
+			continue;
+		}
+		o = lzsequence(c,in,o,anchor,p,p-candidate,match);
+		p += match;
+		anchor = p;
+		if((size_t)(o-out)>=len)
+			return 0;
+	}
+	o = lzsequence(c,in,o,anchor,end,0,0);
+	return (size_t)(o-out)<len ? (size_t)(o-out) : 0;
+}
+
+// copy len bytes in 16 byte steps, which may write up to 15 bytes past the end.
+// src may overlap dst only if it's at least 16 bytes behind it.
+static inline void lzwildcopy(unsigned char *dst, const unsigned char *src, size_t len)
+{
+	unsigned char *end = dst+len;
+	do {
+		memcpy(dst,src,16);
+		dst += 16;
+		src += 16;
+	} while(dst<end);
+}
+
+// decompress into out, which has room for packed->rawlen bytes. Literals and
+// matches are copied 16 bytes at a time while that stays inside the buffers,
+// only matches that overlap themselves closely go a byte at a time.
+static void lzunpack(jwHashCompress *c, jwHashPacked *packed, unsigned char *out)
+{
+	const unsigned char *in = packed->data, *inend = packed->data+packed->packedlen;
+	size_t o = 0, rawlen = packed->rawlen;
+	while(in<inend) {
+		unsigned int token = *in++;
+		size_t literals = token>>4, match = token&15, offset, from;
+		if(literals==15) {
+			unsigned char more;
+			do {
+				more = *in++;
+				literals += more;
+			} while(more==255);
+		}
+		if(literals+HASHLZSLACK<=(size_t)(inend-in) && o+literals+HASHLZSLACK<=rawlen)
+			lzwildcopy(out+o,in,literals);
+		else
+			memcpy(out+o,in,literals);
+		in += literals;
+		o += literals;
+		if(in>=inend)
+			break;
+		offset = in[0] | in[1]<<8;
+		in += 2;
+		if(match==15) {
+			unsigned char more;
+			do {
+				more = *in++;
+				match += more;
+			} while(more==255);
+		}
+		match += HASHLZMINMATCH;
+		from = c->dictlen+o-offset;
+		if(from<c->dictlen) {
+			// the part in the dictionary never overlaps the output, the dictionary has slack after it
+			size_t part = c->dictlen-from < match ? c->dictlen-from : match;
+			if(o+part+HASHLZSLACK<=rawlen)
+				lzwildcopy(out+o,c->dict+from,part);
+			else
+				memcpy(out+o,c->dict+from,part);
+			o += part;
+			match -= part;
+		}
+		if(!match)
+			continue;
+		if(offset>=HASHLZSLACK && o+match+HASHLZSLACK<=rawlen)
+			lzwildcopy(out+o,out+o-offset,match);
+		else if(offset>=match)
+			memcpy(out+o,out+o-offset,match);
+		else {
+			// a short repeating pattern
+			while(match--) {
+				out[o] = out[o-offset];
+				++o;
+			}
+			continue;
+		}
+		o += match;
+	}
+}
+
+// compressed copy of value, or NULL to store it as a plain string
+static jwHashPacked *packstring(jwHashCompress *c, char *value)
+{
+	size_t len = strlen(value);
+	jwHashPacked *packed;
+	size_t packedlen;
+	if(len<HASHLZMINSIZE)
+		return NULL;
+	packed = (jwHashPacked *)malloc(HASHPACKEDHEAD+len+len/255+16);
+	if(!packed) {
+		printf("Unable to allocate compressed value\n");
+		abort();
+	}
+	packedlen = lzpack(c,(unsigned char *)value,len,packed->data);
+	if(!packedlen) {
+		free(packed);
+		return NULL;
+	}
+	packed->rawlen = (unsigned int)len;
+	packed->packedlen = (unsigned int)packedlen;
+	packed->decoded = NULL;
+	return (jwHashPacked *)realloc(packed,HASHPACKEDHEAD+packedlen);
+}
+
+// true if an entry's string value equals value, packed is value compressed or NULL
+static inline int samestring(jwHashEntry *entry, char *value, jwHashPacked *packed)
+{
+	jwHashPacked *current = (jwHashPacked *)entry->value.ptrValue;
+	if(entry->valtag==HASHPACKED) {
+		// compression is deterministic, so equal strings pack to equal bytes
+		return packed && packed->packedlen==current->packedlen && packed->rawlen==current->rawlen &&
+			   0==memcmp(packed->data,current->data,packed->packedlen);
+	}
+	return !packed && 0==strcmp(value,entry->value.strValue);
+}
+
+// store a string value, compressed if packed isn't NULL
+static inline void setstring(jwHashTable *table, jwHashEntry *entry, char *value, jwHashPacked *packed)
+{
+	if(!packed) {
+		entry->valtag = HASHSTRING;
+		entry->value.strValue = copystring(value);
+		return;
+	}
+	entry->valtag = HASHPACKED;
+	entry->value.ptrValue = packed;
+	table->compress->values++;
+	table->compress->rawbytes += packed->rawlen+1;
+	table->compress->storedbytes += HASHPACKEDHEAD+packed->packedlen;
+}
+
+// release a string value, compressed or not
+static inline void freevalue(jwHashTable *table, jwHashEntry *entry)
+{
+	if(entry->valtag==HASHSTRING)
+		freestring(table,entry->value.strValue);
+	else if(entry->valtag==HASHPACKED) {
+		jwHashPacked *packed = (jwHashPacked *)entry->value.ptrValue;
+		table->compress->values--;
+		table->compress->rawbytes -= packed->rawlen+1;
+		table->compress->storedbytes -= HASHPACKEDHEAD+packed->packedlen;
+		if(packed->decoded) {
+			__sync_fetch_and_sub(&table->compress->decodedbytes,packed->rawlen+1);
+			free(packed->decoded);
+		}
+		free(packed);
+	}
+}
+
+// length of a string value including the terminator
+static inline size_t stringlength(jwHashEntry *entry)
+{
+	if(entry->valtag==HASHPACKED)
+		return ((jwHashPacked *)entry->value.ptrValue)->rawlen+1;
+	return strlen(entry->value.strValue)+1;
+}
+
+// copy a string value out to str, which has room for stringlength bytes
+static inline void copyvalue(jwHashTable *table, jwHashEntry *entry, char *str)
+{
+	if(entry->valtag==HASHPACKED) {
+		jwHashPacked *packed = (jwHashPacked *)entry->value.ptrValue;
+		lzunpack(table->compress,packed,(unsigned char *)str);
+		str[packed->rawlen] = 0;
+	} else {
+		strcpy(str,entry->value.strValue);
+	}
+}
+
+// a compressed value decoded for get_str_*. The copy is kept with the value and
+// freed with it, so the pointer lasts as long as a plain string's would. Racing
+// readers each decode, the first to install its copy wins.
+static char *unpackvalue(jwHashTable *table, jwHashEntry *entry)
+{
+	jwHashPacked *packed = (jwHashPacked *)entry->value.ptrValue;
+	char *decoded = packed->decoded;
+	if(decoded)
+		return decoded;
+	decoded = (char *)malloc(packed->rawlen+1);
+	if(!decoded) {
+		printf("Unable to allocate decoded value\n");
+		abort();
+	}
+	copyvalue(table,entry,decoded);
+	if(!__sync_bool_compare_and_swap(&packed->decoded,NULL,decoded)) {
+		free(decoded);
+		return packed->decoded;
+	}
+	__sync_fetch_and_add(&table->compress->decodedbytes,packed->rawlen+1);
+	return decoded;
+}
+
+static void freecompress( jwHashCompress *c )
+{
+	if(!c)
+		return;
+	free(c->dict);
+	free(c);
+}
+
+// Compress string values added from now on, with an optional shared dictionary
+// of typical content. Only the last 64 KiB of the dictionary can be referenced.
+HASHRESULT enable_compression( jwHashTable *table, char *dict, size_t dictlen )
+{
+	jwHashCompress *c;
+	size_t p;
+	if(table->shared)
+		return HASHSHARED;
+	if(table->frozen)
+		return HASHFROZEN;
+	if(table->compress)
+		return HASHALREADYADDED;		// stored values depend on the dictionary
+	c = (jwHashCompress *)calloc(1,sizeof(jwHashCompress));
+	if(!c)
+		return HASHNOTFOUND;
+	if(dict && dictlen>HASHLZWINDOW) {
+		dict += dictlen-HASHLZWINDOW;
+		dictlen = HASHLZWINDOW;
+	}
+	c->dictlen = dict ? dictlen : 0;
+	c->dict = (unsigned char *)calloc(1,c->dictlen+HASHLZSLACK);
+	if(!c->dict) {
+		free(c);
+		return HASHNOTFOUND;
+	}
+	if(c->dictlen)
+		memcpy(c->dict,dict,c->dictlen);
+	memset(c->dicthash,-1,sizeof(c->dicthash));
+	for(p=0;p+HASHLZMINMATCH<=c->dictlen;++p)
+		c->dicthash[lzhash(c,NULL,p)] = (int)p;
+	table->compress = c;
+	return HASHOK;
+}
+
+// Memory saved by compression so far
+HASHRESULT get_compression_stats( jwHashTable *table, jwHashCompressStats *stats )
+{
+	jwHashCompress *c = table->compress;
+	if(!c)
+		return HASHNOTFOUND;
+	stats->values = c->values;
+	stats->rawbytes = c->rawbytes;
+	stats->storedbytes = c->storedbytes;
+	stats->decodedbytes = c->decodedbytes;
+	stats->dictbytes = c->dictlen;
+	return HASHOK;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// ORDERED INDEX
+//
+// One B+-tree per key type over the table's own entries, for prefix scans on
+// string keys and range scans on int keys. Each slot keeps a sortable 64 bit
+// key inline, so most comparisons don't touch the entry: the int key itself,
+// or the first 8 bytes of a string key, big endian with the top bit flipped so
+// a signed compare orders like strcmp. Ties are settled with the full string.
+// Inner nodes keep their own copies of separator strings so they outlive the
+// entries. Deletes don't merge nodes and may leave leaves empty, lookups and
+// scans pass over them; call enable_index again to compact.
+
+#define HASHINDEXFANOUT		32			// slots per node
+#define HASHINDEXFILL		24			// slots used per node when building, room to grow
+
+typedef struct jwHashIndexNode jwHashIndexNode;
+struct jwHashIndexNode
+{
+	int count;
+	int leaf;
+	jwHashIndexNode *next;				// leaves: the next leaf in key order
+	long int keys[HASHINDEXFANOUT];		// inner: lowest key under each child
+	char *strs[HASHINDEXFANOUT];		// string keys, copies in inner nodes
+	void *ptrs[HASHINDEXFANOUT];		// leaves: entries, inner: children
+};
+
+struct jwHashIndex
+{
+	jwHashIndexNode *root[2];			// by HASHKEYTAG
+	size_t count[2];
+#ifdef HASHTHREADED
+	volatile int lock;
+#endif
+};
+
+static inline long int indexkey(char *str)
+{
+	unsigned long int k = 0;
+	int i;
+	for(i=0;i<8 && str[i];++i)
+		k |= (unsigned long int)(unsigned char)str[i] << (56-8*i);
+	return (long int)(k ^ 0x8000000000000000ul);
+}
+
+static inline long int entrykey(jwHashEntry *entry)
+{
+	return entry->keytag==HASHKEYSTR ? indexkey(entry->key.strValue) : entry->key.intValue;
+}
+
+static inline int indexcmp(long int ka, char *sa, long int kb, char *sb)
+{
+	if(ka!=kb)
+		return ka<kb ? -1 : 1;
+	return sa ? strcmp(sa,sb) : 0;
+}
+
+// first slot of a leaf that isn't below the key
+static inline int leafpos(jwHashIndexNode *node, long int k, char *s)
+{
+	int lo = 0, hi = node->count;
+	while(lo<hi) {
+		int mid = (lo+hi)/2;
+		if(indexcmp(node->keys[mid],node->strs[mid],k,s)<0)
+			lo = mid+1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+// child of an inner node the key belongs under: the last one whose lowest key is
+// below it, so a run of equal keys split across children is found from its start
+static inline int innerpos(jwHashIndexNode *node, long int k, char *s)
+{
+	int lo = 1, hi = node->count;
+	while(lo<hi) {
+		int mid = (lo+hi)/2;
+		if(indexcmp(node->keys[mid],node->strs[mid],k,s)<0)
+			lo = mid+1;
+		else
+			hi = mid;
+	}
+	return lo-1;
+}
+
+static jwHashIndexNode *newnode(int leaf)
+{
+	jwHashIndexNode *node = (jwHashIndexNode *)calloc(1,sizeof(jwHashIndexNode));
+	if(!node) {
+		printf("Unable to allocate index node\n");
+		abort();
+	}
+	node->leaf = leaf;
+	return node;
+}
+
+static void freenode(jwHashIndexNode *node)
+{
+	int i;
+	if(!node->leaf) {
+		for(i=0;i<node->count;++i) {
+			free(node->strs[i]);
+			freenode((jwHashIndexNode *)node->ptrs[i]);
+		}
+	}
+	free(node);
+}
+
+static inline char *copysep(char *str)
+{
+	return str ? copystring(str) : NULL;
+}
+
+// put a slot at pos, splitting a full node in half first; returns the new
+// right half or NULL
+static jwHashIndexNode *nodeinsert(jwHashIndexNode *node, int pos, long int k, char *s, void *ptr)
+{
+	jwHashIndexNode *right = NULL;
+	if(node->count==HASHINDEXFANOUT) {
+		int half = HASHINDEXFANOUT/2;
+		right = newnode(node->leaf);
+		right->count = HASHINDEXFANOUT-half;
+		memcpy(right->keys,node->keys+half,right->count*sizeof(long int));
+		memcpy(right->strs,node->strs+half,right->count*sizeof(char *));
+		memcpy(right->ptrs,node->ptrs+half,right->count*sizeof(void *));
+		node->count = half;
+		if(node->leaf) {
+			right->next = node->next;
+			node->next = right;
+		}
+		if(pos>half) {
+			node = right;
+			pos -= half;
+		}
+	}
+	memmove(node->keys+pos+1,node->keys+pos,(node->count-pos)*sizeof(long int));
+	memmove(node->strs+pos+1,node->strs+pos,(node->count-pos)*sizeof(char *));
+	memmove(node->ptrs+pos+1,node->ptrs+pos,(node->count-pos)*sizeof(void *));
+	node->keys[pos] = k;
+	node->strs[pos] = s;
+	node->ptrs[pos] = ptr;
+	node->count++;
+	return right;
+}
+
+static jwHashIndexNode *treeinsert(jwHashIndexNode *node, long int k, char *s, jwHashEntry *entry)
+{
+	jwHashIndexNode *split;
+	int i;
+	if(node->leaf)
+		return nodeinsert(node,leafpos(node,k,s),k,s,entry);
+	i = innerpos(node,k,s);
+	split = treeinsert((jwHashIndexNode *)node->ptrs[i],k,s,entry);
+	if(!split)
+		return NULL;
+	return nodeinsert(node,i+1,split->keys[0],copysep(split->strs[0]),split);
+}
+
+// leaf and slot holding the first key not below k/s, NULL past the end. Deletes
+// can leave leaves empty, they're passed over here like any leaf without the key,
+// so the leaf returned always has a slot at *pos.
+static jwHashIndexNode *treefind(jwHashIndexNode *node, long int k, char *s, int *pos)
+{
+	while(node && !node->leaf)
+		node = (jwHashIndexNode *)node->ptrs[innerpos(node,k,s)];
+	if(!node)
+		return NULL;
+	*pos = leafpos(node,k,s);
+	while(node && *pos==node->count) {
+		node = node->next;
+		*pos = 0;
+	}
+	return node;
+}
+
+#ifdef HASHTHREADED
+static inline void lockindex(jwHashIndex *index)
+{
+	while (__sync_lock_test_and_set(&index->lock, 1)) {
+		// spin
+	}
+}
+
+static inline void unlockindex(jwHashIndex *index)
+{
+	__sync_lock_release(&index->lock);
+}
+#endif
+
+// a new entry was linked into the buckets
+static void indexadd(jwHashIndex *index, jwHashEntry *entry)
+{
+	int t = entry->keytag;
+	char *s = t==HASHKEYSTR ? entry->key.strValue : NULL;
+	long int k = entrykey(entry);
+	jwHashIndexNode *split;
+#ifdef HASHTHREADED
+	lockindex(index);
+#endif
+	if(!index->root[t])
+		index->root[t] = newnode(1);
+	split = treeinsert(index->root[t],k,s,entry);
+	if(split) {
+		jwHashIndexNode *root = newnode(0);
+		root->count = 2;
+		root->keys[0] = index->root[t]->keys[0];
+		root->ptrs[0] = index->root[t];
+		root->keys[1] = split->keys[0];
+		root->strs[1] = copysep(split->strs[0]);
+		root->ptrs[1] = split;
+		index->root[t] = root;
+	}
+	index->count[t]++;
+#ifdef HASHTHREADED
+	unlockindex(index);
+#endif
+}
+
+// find the slot pointing at entry, searching the whole run of slots with its key
+static jwHashIndexNode *indexslot(jwHashIndex *index, jwHashEntry *entry, int *pos)
+{
+	char *s = entry->keytag==HASHKEYSTR ? entry->key.strValue : NULL;
+	long int k = entrykey(entry);
+	jwHashIndexNode *leaf = treefind(index->root[entry->keytag],k,s,pos);
+	for(;leaf;leaf=leaf->next,*pos=0) {
+		for(;*pos<leaf->count;++*pos) {
+			if(indexcmp(leaf->keys[*pos],leaf->strs[*pos],k,s))
+				return NULL;
+			if(leaf->ptrs[*pos]==entry)
+				return leaf;
+		}
+	}
+	return NULL;
+}
+
+// an entry is about to be unlinked and freed
+static void indexdel(jwHashIndex *index, jwHashEntry *entry)
+{
+	jwHashIndexNode *leaf;
+	int pos;
+#ifdef HASHTHREADED
+	lockindex(index);
+#endif
+	leaf = indexslot(index,entry,&pos);
+	if(!leaf) {
+		// a scan would reach the freed entry through the slot left behind
+		printf("Index has no slot for a deleted entry\n");
+		abort();
+	}
+	leaf->count--;
+	memmove(leaf->keys+pos,leaf->keys+pos+1,(leaf->count-pos)*sizeof(long int));
+	memmove(leaf->strs+pos,leaf->strs+pos+1,(leaf->count-pos)*sizeof(char *));
+	memmove(leaf->ptrs+pos,leaf->ptrs+pos+1,(leaf->count-pos)*sizeof(void *));
+	index->count[entry->keytag]--;
+#ifdef HASHTHREADED
+	unlockindex(index);
+#endif
+}
+
+// a multi entry is about to be realloc'd: find its slot while the old pointer is
+// still valid, and keep the index locked until indexmoved stores the new one
+static jwHashIndexNode *indexmoving(jwHashIndex *index, jwHashEntry *entry, int *pos)
+{
+	jwHashIndexNode *leaf;
+#ifdef HASHTHREADED
+	lockindex(index);
+#endif
+	leaf = indexslot(index,entry,pos);
+	if(!leaf) {
+		printf("Index has no slot for a moved entry\n");
+		abort();
+	}
+	return leaf;
+}
+
+static void indexmoved(jwHashIndex *index, jwHashIndexNode *leaf, int pos, jwHashEntry *entry)
+{
+	leaf->ptrs[pos] = entry;
+#ifdef HASHTHREADED
+	unlockindex(index);
+#else
+	(void)index;
+#endif
+}
+
+static void freeindex( jwHashIndex *index )
+{
+	if(!index)
+		return;
+	if(index->root[HASHKEYSTR])
+		freenode(index->root[HASHKEYSTR]);
+	if(index->root[HASHKEYINT])
+		freenode(index->root[HASHKEYINT]);
+	free(index);
+}
+
+static int entrycmp(const void *a, const void *b)
+{
+	jwHashEntry *x = *(jwHashEntry **)a, *y = *(jwHashEntry **)b;
+	return indexcmp(entrykey(x),x->keytag==HASHKEYSTR ? x->key.strValue : NULL,
+					entrykey(y),y->keytag==HASHKEYSTR ? y->key.strValue : NULL);
+}
+
+// build a tree bottom up from sorted entries, each node HASHINDEXFILL full
+static jwHashIndexNode *treebuild(jwHashEntry **sorted, size_t count)
+{
+	size_t nodes = (count+HASHINDEXFILL-1)/HASHINDEXFILL, i, n;
+	jwHashIndexNode **level, *prev = NULL;
+	if(!count)
+		return NULL;
+	level = (jwHashIndexNode **)malloc(nodes*sizeof(jwHashIndexNode *));
+	if(!level) {
+		printf("Unable to allocate index\n");
+		abort();
+	}
+	for(n=0;n<nodes;++n) {
+		jwHashIndexNode *leaf = newnode(1);
+		for(i=n*HASHINDEXFILL;i<count && leaf->count<HASHINDEXFILL;++i) {
+			jwHashEntry *entry = sorted[i];
+			leaf->keys[leaf->count] = entrykey(entry);
+			leaf->strs[leaf->count] = entry->keytag==HASHKEYSTR ? entry->key.strValue : NULL;
+			leaf->ptrs[leaf->count++] = entry;
+		}
+		if(prev)
+			prev->next = leaf;
+		level[n] = prev = leaf;
+	}
+	while(nodes>1) {
+		size_t parents = (nodes+HASHINDEXFILL-1)/HASHINDEXFILL;
+		for(n=0;n<parents;++n) {
+			jwHashIndexNode *inner = newnode(0);
+			for(i=n*HASHINDEXFILL;i<nodes && inner->count<HASHINDEXFILL;++i) {
+				inner->keys[inner->count] = level[i]->keys[0];
+				inner->strs[inner->count] = copysep(level[i]->strs[0]);
+				inner->ptrs[inner->count++] = level[i];
+			}
+			level[n] = inner;
+		}
+		nodes = parents;
+	}
+	prev = level[0];
+	free(level);
+	return prev;
+}
+
+// Keep an ordered index of the keys from now on, for scan_prefix_by_str and
+// scan_range_by_int. Costs an extra tree insert or delete in each add_* or del_*
+// that adds or removes a key.
+HASHRESULT enable_index( jwHashTable *table )
+{
+	jwHashEntry **sorted[2];
+	size_t counts[2] = {0,0}, b;
+	int t;
+	if(table->shared)
+		return HASHSHARED;
+	if(table->frozen)
+		return HASHFROZEN;
+	disable_index(table);
+	for(b=0;b<table->buckets;++b) {
+		jwHashEntry *entry;
+		for(entry=table->bucket[b];entry;entry=entry->next)
+			counts[entry->keytag]++;
+	}
+	table->index = (jwHashIndex *)calloc(1,sizeof(jwHashIndex));
+	sorted[0] = (jwHashEntry **)malloc((counts[0]+1)*sizeof(jwHashEntry *));
+	sorted[1] = (jwHashEntry **)malloc((counts[1]+1)*sizeof(jwHashEntry *));
+	if(!table->index || !sorted[0] || !sorted[1]) {
+		free(table->index);
+		free(sorted[0]);
+		free(sorted[1]);
+		table->index = NULL;
+		return HASHNOTFOUND;
+	}
+	counts[0] = counts[1] = 0;
+	for(b=0;b<table->buckets;++b) {
+		jwHashEntry *entry;
+		for(entry=table->bucket[b];entry;entry=entry->next)
+			sorted[entry->keytag][counts[entry->keytag]++] = entry;
+	}
+	for(t=0;t<2;++t) {
+		qsort(sorted[t],counts[t],sizeof(jwHashEntry *),entrycmp);
+		table->index->root[t] = treebuild(sorted[t],counts[t]);
+		table->index->count[t] = counts[t];
+		free(sorted[t]);
+	}
+	return HASHOK;
+}
+
+HASHRESULT disable_index( jwHashTable *table )
+{
+	if(!table->index)
+		return HASHNOTFOUND;
+	freeindex(table->index);
+	table->index = NULL;
+	return HASHOK;
+}
+
+// Call fn on each string keyed entry starting with prefix, in key order, until
+// it returns non-zero. fn mustn't change the table.
+HASHRESULT scan_prefix_by_str( jwHashTable *table, char *prefix, jwHashScanFunc fn, void *arg )
+{
+	HASHRESULT result = HASHNOTFOUND;
+	size_t len = strlen(prefix);
+	jwHashIndexNode *leaf;
+	int pos;
+	if(table->frozen)
+		return HASHFROZEN;
+	if(!table->index)
+		return HASHNOINDEX;
+#ifdef HASHTHREADED
+	lockindex(table->index);
+#endif
+	for(leaf=treefind(table->index->root[HASHKEYSTR],indexkey(prefix),prefix,&pos);leaf;leaf=leaf->next,pos=0) {
+		for(;pos<leaf->count;++pos) {
+			if(strncmp(leaf->strs[pos],prefix,len))
+				goto done;
+			result = HASHOK;
+			if(fn((jwHashEntry *)leaf->ptrs[pos],arg))
+				goto done;
+		}
+	}
+done:
+#ifdef HASHTHREADED
+	unlockindex(table->index);
+#endif
+	return result;
+}
+
+// Call fn on each int keyed entry with lo <= key <= hi, in key order, until it
+// returns non-zero. fn mustn't change the table.
+HASHRESULT scan_range_by_int( jwHashTable *table, long int lo, long int hi, jwHashScanFunc fn, void *arg )
+{
+	HASHRESULT result = HASHNOTFOUND;
+	jwHashIndexNode *leaf;
+	int pos;
+	if(table->frozen)
+		return HASHFROZEN;
+	if(!table->index)
+		return HASHNOINDEX;
+#ifdef HASHTHREADED
+	lockindex(table->index);
+#endif
+	for(leaf=treefind(table->index->root[HASHKEYINT],lo,NULL,&pos);leaf;leaf=leaf->next,pos=0) {
+		for(;pos<leaf->count;++pos) {
+			if(leaf->keys[pos]>hi)
+				goto done;
+			result = HASHOK;
+			if(fn((jwHashEntry *)leaf->ptrs[pos],arg))
+				goto done;
+		}
+	}
+done:
+#ifdef HASHTHREADED
+	unlockindex(table->index);
+#endif
+	return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// SHARED MEMORY TABLES
+//
+// The whole table - header, buckets, bucket locks, entries and strings - lives
+// in one mapping shared between processes, so forked or unrelated workers use
+// one copy. Nothing in the segment holds a pointer, since each process may map
+// it at a different address: chains, keys and string values are offsets from
+// the start of the segment, 0 meaning none. Buckets are guarded by spinlocks
+// in the segment, and a second lock guards the allocator, which hands out
+// power of two blocks from the free space and keeps freed ones on a list per
+// size. The segment doesn't grow, add_* return HASHNOSPACE once it's full.
+// A process that dies holding a lock leaves it held.
+
+#define HASHSHMMAGIC		"jwHashS1"
+#define HASHSHMMINBLOCK		16			// smallest block, all blocks are aligned to it
+#define HASHSHMCLASSES		40			// block sizes HASHSHMMINBLOCK << 0..39
+
+typedef struct jwHashShmHeader jwHashShmHeader;
+struct jwHashShmHeader
+{
+	char magic[8];						// set last, once the segment is ready
+	size_t size;						// bytes in the segment
+	size_t buckets;
+	size_t bucketoffset;				// size_t offset of each chain
+	size_t lockoffset;					// int lock per bucket
+	size_t top;							// free space starts here
+	size_t freelist[HASHSHMCLASSES];	// freed blocks of each size
+	size_t entries;
+	volatile int lock;					// allocator lock
+};
+
+typedef struct jwHashShmEntry jwHashShmEntry;
+struct jwHashShmEntry
+{
+	size_t next;
+	union
+	{
+		size_t strOffset;
+		long int intValue;
+	} key;
+	HASHVALTAG valtag;
+	HASHKEYTAG keytag;
+	union
+	{
+		size_t strOffset;
+		double dblValue;
+		long int intValue;
+		void  *ptrValue;				// only meaningful to processes that agree on it
+	} value;
+};
+
+// this process's view of the segment
+struct jwHashShared
+{
+	char *base;
+	jwHashShmHeader *head;
+	size_t *bucket;
+	volatile int *locks;
+};
+
+#define SHMAT(shm,offset)	((shm)->base+(offset))
+#define SHMENTRY(shm,offset)	((jwHashShmEntry *)SHMAT(shm,offset))
+
+#ifdef __linux__
+static inline void lockshared(volatile int *lock)
+{
+	while (__sync_lock_test_and_set(lock, 1)) {
+		// spin
+	}
+}
+
+static inline void unlockshared(volatile int *lock)
+{
+	__sync_lock_release(lock);
+}
+
+static inline int shmclass(size_t size)
+{
+	int c = 0;
+	while(((size_t)HASHSHMMINBLOCK<<c)<size)
+		++c;
+	return c;
+}
+
+// a block of at least size bytes, or 0 if the segment is full
+static size_t shmalloc(jwHashShared *shm, size_t size)
+{
+	jwHashShmHeader *head = shm->head;
+	int c = shmclass(size);
+	size_t offset = 0;
+	if(c>=HASHSHMCLASSES)
+		return 0;
+	lockshared(&head->lock);
+	if(head->freelist[c]) {
+		offset = head->freelist[c];
+		head->freelist[c] = *(size_t *)SHMAT(shm,offset);
+	} else if(head->size - head->top >= (size_t)HASHSHMMINBLOCK<<c) {
+		offset = head->top;
+		head->top += (size_t)HASHSHMMINBLOCK<<c;
+	}
+	unlockshared(&head->lock);
+	return offset;
+}
+
+static void shmfree(jwHashShared *shm, size_t offset, size_t size)
+{
+	jwHashShmHeader *head = shm->head;
+	int c = shmclass(size);
+	if(!offset)
+		return;
+	lockshared(&head->lock);
+	*(size_t *)SHMAT(shm,offset) = head->freelist[c];
+	head->freelist[c] = offset;
+	unlockshared(&head->lock);
+}
+
+static size_t shmstring(jwHashShared *shm, char *str)
+{
+	size_t len = strlen(str)+1;
+	size_t offset = shmalloc(shm,len);
+	if(offset)
+		memcpy(SHMAT(shm,offset),str,len);
+	return offset;
+}
+
+static inline void shmfreestring(jwHashShared *shm, size_t offset)
+{
+	if(offset)
+		shmfree(shm,offset,strlen(SHMAT(shm,offset))+1);
+}
+
+// find the link to key's entry, or the empty link at the end of its chain;
+// the bucket is locked by the caller
+static inline size_t *sharedlink(jwHashShared *shm, size_t hash, HASHKEYTAG keytag, char *strkey, long int intkey)
+{
+	size_t *link = &shm->bucket[hash];
+	while(*link) {
+		jwHashShmEntry *entry = SHMENTRY(shm,*link);
+		if(entry->keytag==keytag && (keytag==HASHKEYSTR ? 0==strcmp(SHMAT(shm,entry->key.strOffset),strkey) : entry->key.intValue==intkey))
+			break;
+		link = &entry->next;
+	}
+	return link;
+}
+
+static inline int samevalue(jwHashShared *shm, jwHashShmEntry *entry, jwHashEntry *item)
+{
+	if(entry->valtag!=item->valtag)
+		return 0;
+	// numbers are int or double, compare all their bits
+	if(item->valtag==HASHSTRING)
+		return 0==strcmp(SHMAT(shm,entry->value.strOffset),item->value.strValue);
+	return 0==memcmp(&entry->value,&item->value,sizeof(entry->value));
+}
+
+// store item's value in entry, copying strings into the segment
+static inline int setshared(jwHashShared *shm, jwHashShmEntry *entry, jwHashEntry *item)
+{
+	entry->valtag = item->valtag;
+	if(item->valtag==HASHSTRING) {
+		entry->value.strOffset = shmstring(shm,item->value.strValue);
+		return entry->value.strOffset!=0;
+	}
+	memcpy(&entry->value,&item->value,sizeof(entry->value));
+	return 1;
+}
+
+static HASHRESULT sharedadd(jwHashTable *table, long int keyhash, HASHKEYTAG keytag, char *strkey, long int intkey, jwHashEntry *item)
+{
+	jwHashShared *shm = table->shared;
+	size_t hash = keyhash % shm->head->buckets;
+	HASHRESULT result = HASHOK;
+	jwHashShmEntry *entry, old;
+	size_t *link, offset;
+
+	lockshared(&shm->locks[hash]);
+	link = sharedlink(shm,hash,keytag,strkey,intkey);
+	if(*link) {
+		entry = SHMENTRY(shm,*link);
+		if(samevalue(shm,entry,item)) {
+			result = HASHALREADYADDED;
+		} else {
+			old = *entry;
+			if(!setshared(shm,entry,item)) {
+				*entry = old;
+				result = HASHNOSPACE;
+			} else {
+				if(old.valtag==HASHSTRING)
+					shmfreestring(shm,old.value.strOffset);
+				result = HASHREPLACEDVALUE;
+			}
+		}
+		unlockshared(&shm->locks[hash]);
+		return result;
+	}
+
+	// new entry at the head of the chain
+	offset = shmalloc(shm,sizeof(jwHashShmEntry));
+	if(!offset) {
+		unlockshared(&shm->locks[hash]);
+		return HASHNOSPACE;
+	}
+	entry = SHMENTRY(shm,offset);
+	entry->keytag = keytag;
+	if(keytag==HASHKEYSTR)
+		entry->key.strOffset = shmstring(shm,strkey);
+	else
+		entry->key.intValue = intkey;
+	if((keytag==HASHKEYSTR && !entry->key.strOffset) || !setshared(shm,entry,item)) {
+		if(keytag==HASHKEYSTR)
+			shmfreestring(shm,entry->key.strOffset);
+		shmfree(shm,offset,sizeof(jwHashShmEntry));
+		unlockshared(&shm->locks[hash]);
+		return HASHNOSPACE;
+	}
+	entry->next = shm->bucket[hash];
+	shm->bucket[hash] = offset;
+	__sync_fetch_and_add(&shm->head->entries,1);
+	unlockshared(&shm->locks[hash]);
+	return result;
+}
+
+static HASHRESULT shareddel(jwHashTable *table, long int keyhash, HASHKEYTAG keytag, char *strkey, long int intkey)
+{
+	jwHashShared *shm = table->shared;
+	size_t hash = keyhash % shm->head->buckets;
+	jwHashShmEntry *entry;
+	size_t *link, offset;
+
+	lockshared(&shm->locks[hash]);
+	link = sharedlink(shm,hash,keytag,strkey,intkey);
+	if(!*link) {
+		unlockshared(&shm->locks[hash]);
+		return HASHNOTFOUND;
+	}
+	offset = *link;
+	entry = SHMENTRY(shm,offset);
+	*link = entry->next;
+	if(entry->valtag==HASHSTRING)
+		shmfreestring(shm,entry->value.strOffset);
+	if(keytag==HASHKEYSTR)
+		shmfreestring(shm,entry->key.strOffset);
+	shmfree(shm,offset,sizeof(jwHashShmEntry));
+	__sync_fetch_and_sub(&shm->head->entries,1);
+	unlockshared(&shm->locks[hash]);
+	return HASHDELETED;
+}
+
+// copy out the value, string values point into the segment; with buf, string
+// values are copied there as get_strbuf_* do, while the bucket is still locked
+static HASHRESULT sharedget(jwHashTable *table, long int keyhash, HASHKEYTAG keytag, char *strkey, long int intkey,
+							jwHashEntry *item, char *buf, size_t size, size_t *length)
+{
+	jwHashShared *shm = table->shared;
+	size_t hash = keyhash % shm->head->buckets;
+	HASHRESULT result = HASHOK;
+	jwHashShmEntry *entry;
+	size_t *link;
+
+	lockshared(&shm->locks[hash]);
+	link = sharedlink(shm,hash,keytag,strkey,intkey);
+	if(!*link) {
+		unlockshared(&shm->locks[hash]);
+		return HASHNOTFOUND;
+	}
+	entry = SHMENTRY(shm,*link);
+	item->valtag = entry->valtag;
+	if(entry->valtag==HASHSTRING)
+		item->value.strValue = SHMAT(shm,entry->value.strOffset);
+	else
+		memcpy(&item->value,&entry->value,sizeof(item->value));
+	if(buf) {
+		if(entry->valtag!=HASHSTRING) {
+			result = HASHNOTFOUND;
+		} else {
+			*length = strlen(item->value.strValue);
+			if(*length<size)
+				memcpy(buf,item->value.strValue,*length+1);
+		}
+	}
+	unlockshared(&shm->locks[hash]);
+	return result;
+}
+
+static jwHashTable *sharedtable(char *base)
+{
+	jwHashTable *table = (jwHashTable *)calloc(1,sizeof(jwHashTable));
+	jwHashShared *shm = (jwHashShared *)calloc(1,sizeof(jwHashShared));
+	if(!table || !shm) {
+		free(table);
+		free(shm);
+		return NULL;
+	}
+	shm->base = base;
+	shm->head = (jwHashShmHeader *)base;
+	shm->bucket = (size_t *)(base+shm->head->bucketoffset);
+	shm->locks = (volatile int *)(base+shm->head->lockoffset);
+	table->shared = shm;
+	table->buckets = table->bucketsinitial = shm->head->buckets;
+	table->lastError = HASHOK;
+	return table;
+}
+
+// Create a table in a new shared memory segment of bytes. With a name, other
+// processes can attach_shared_hash it until unlink_shared_hash; without one
+// it's anonymous and only shared with processes forked from this one.
+jwHashTable *create_shared_hash( const char *name, size_t buckets, size_t bytes )
+{
+	size_t bucketoffset = (sizeof(jwHashShmHeader)+HASHSHMMINBLOCK-1) & ~(size_t)(HASHSHMMINBLOCK-1);
+	size_t lockoffset = bucketoffset + buckets*sizeof(size_t);
+	size_t top = (lockoffset + buckets*sizeof(int)+HASHSHMMINBLOCK-1) & ~(size_t)(HASHSHMMINBLOCK-1);
+	jwHashShmHeader *head;
+	jwHashTable *table;
+	char *base;
+
+	if(!buckets || bytes<top)
+		return NULL;
+	if(name) {
+		int fd = shm_open(name,O_RDWR|O_CREAT|O_EXCL,0600);
+		if(fd<0)
+			return NULL;
+		if(ftruncate(fd,bytes)) {
+			close(fd);
+			shm_unlink(name);
+			return NULL;
+		}
+		base = (char *)mmap(NULL,bytes,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+		close(fd);
+		if(base==MAP_FAILED)
+			shm_unlink(name);
+	} else {
+		base = (char *)mmap(NULL,bytes,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_ANONYMOUS,-1,0);
+	}
+	if(base==MAP_FAILED)
+		return NULL;
+
+	// a fresh mapping is zeroed, so buckets, locks and freelists start empty
+	head = (jwHashShmHeader *)base;
+	head->size = bytes;
+	head->buckets = buckets;
+	head->bucketoffset = bucketoffset;
+	head->lockoffset = lockoffset;
+	head->top = top;
+	__sync_synchronize();
+	memcpy(head->magic,HASHSHMMAGIC,sizeof(head->magic));
+
+	table = sharedtable(base);
+	if(!table) {
+		munmap(base,bytes);
+		if(name)
+			shm_unlink(name);
+	}
+	return table;
+}
+
+// Map a named segment made by create_shared_hash in another process
+jwHashTable *attach_shared_hash( const char *name )
+{
+	struct stat st;
+	jwHashTable *table;
+	char *base;
+	int fd = shm_open(name,O_RDWR,0);
+	if(fd<0)
+		return NULL;
+	if(fstat(fd,&st) || (size_t)st.st_size<sizeof(jwHashShmHeader)) {
+		close(fd);
+		return NULL;
+	}
+	base = (char *)mmap(NULL,st.st_size,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+	close(fd);
+	if(base==MAP_FAILED)
+		return NULL;
+	if(memcmp(((jwHashShmHeader *)base)->magic,HASHSHMMAGIC,sizeof(((jwHashShmHeader *)base)->magic)) ||
+	   ((jwHashShmHeader *)base)->size!=(size_t)st.st_size || !(table = sharedtable(base))) {
+		munmap(base,st.st_size);
+		return NULL;
+	}
+	return table;
+}
+
+// Remove a named segment, processes that have it mapped keep using it
+HASHRESULT unlink_shared_hash( const char *name )
+{
+	return shm_unlink(name) ? HASHNOTFOUND : HASHDELETED;
+}
+
+static void detachshared( jwHashShared *shm )
+{
+	munmap(shm->base,shm->head->size);
+	free(shm);
+}
+#else
+static HASHRESULT sharedadd(jwHashTable *table, long int keyhash, HASHKEYTAG keytag, char *strkey, long int intkey, jwHashEntry *item)
+{
+	return HASHSHARED;
+}
+
+static HASHRESULT shareddel(jwHashTable *table, long int keyhash, HASHKEYTAG keytag, char *strkey, long int intkey)
 {
-	unsigned long hash = 5381;
-	int c;
+	return HASHSHARED;
+}
 
-	while (c = *str++)
-		hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
-	return hash;
+static HASHRESULT sharedget(jwHashTable *table, long int keyhash, HASHKEYTAG keytag, char *strkey, long int intkey,
+							jwHashEntry *item, char *buf, size_t size, size_t *length)
+{
+	return HASHSHARED;
 }
 
-// helper for copying string keys and values
-static inline char * copystring(char * value)
+jwHashTable *create_shared_hash( const char *name, size_t buckets, size_t bytes )
 {
-	char * copy = (char *)malloc(strlen(value)+1);
-	if(!copy) {
-		printf("Unable to allocate string value %s\n",value);
-		abort();
-	}
-	strcpy(copy,value);
-	return copy;
+	return NULL;
 }
 
+jwHashTable *attach_shared_hash( const char *name )
+{
+	return NULL;
+}
 
-////////////////////////////////////////////////////////////////////////////////
-// CREATING A NEW HASH TABLE
+HASHRESULT unlink_shared_hash( const char *name )
+{
+	return HASHNOTFOUND;
+}
 
-// Create hash table
-jwHashTable *create_hash( size_t buckets )
+static void detachshared( jwHashShared *shm )
 {
-	// allocate space
-	jwHashTable *table= (jwHashTable *)malloc(sizeof(jwHashTable));
-	if(!table) {
-		// unable to allocate
-		return NULL;
-	}
-	// locks
-#ifdef HASHTHREADED
-	table->lock = 0;
-	table->locks = (int *)malloc(buckets * sizeof(int));
-	if( !table->locks ) {
-		free(table);
-		return NULL;
-	}
-	memset((int *)&table->locks[0],0,buckets*sizeof(int));
+}
 #endif
-	// setup
-	table->bucket = (jwHashEntry **)malloc(buckets*sizeof(void*));
-	if( !table->bucket ) {
-		free(table);
-		return NULL;
-	}
-	memset(table->bucket,0,buckets*sizeof(void*));
-	table->buckets = table->bucketsinitial = buckets;
-	HASH_DEBUG("table: %x bucket: %x\n",table,table->bucket);
-	return table;
+
+// How full the segment is
+HASHRESULT get_shared_stats( jwHashTable *table, jwHashSharedStats *stats )
+{
+	jwHashShmHeader *head;
+	if(!table->shared)
+		return HASHNOTFOUND;
+	head = table->shared->head;
+	stats->bytes = head->size;
+	stats->used = head->top;
+	stats->entries = head->entries;
+	return HASHOK;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -108,10 +2988,21 @@ jwHashTable *create_hash( size_t buckets )
 // Add str to table - keyed by string
 HASHRESULT add_str_by_str( jwHashTable *table, char *key, char *value )
 {
+	if(table->shared) {
+		jwHashEntry item = { .valtag = HASHSTRING, .value.strValue = value };
+		return sharedadd(table,hashString(key),HASHKEYSTR,key,0,&item);
+	}
+	if(table->frozen)
+		return HASHFROZEN;
+
 	// compute hash on key
-	size_t hash = hashString(key) % table->buckets;
+	long int keyhash = hashString(key);
+	size_t hash = keyhash % table->buckets;
 	HASH_DEBUG("adding %s -> %s hash: %ld\n",key,value,hash);
 
+	// compress up front, so an unchanged value can be spotted without decoding
+	jwHashPacked *packed = table->compress ? packstring(table->compress,value) : NULL;
+
 	// add entry
 	jwHashEntry *entry = table->bucket[hash];
 	
@@ -120,14 +3011,20 @@ HASHRESULT add_str_by_str( jwHashTable *table, char *key, char *value )
 	while(entry!=0)
 	{
 		HASH_DEBUG("checking entry: %x\n",entry);
+		// keys holding several values only change through add_multi_*
+		if(0==strcmp(entry->key.strValue,key) && entry->valtag==HASHMULTI)
+			return HASHALREADYADDED;
 		// check for already indexed
-		if(0==strcmp(entry->key.strValue,key) && 0==strcmp(value,entry->value.strValue))
+		if(0==strcmp(entry->key.strValue,key) && samestring(entry,value,packed))
+		{
+			free(packed);
 			return HASHALREADYADDED;
+		}
 		// check for replacing entry
-		if(0==strcmp(entry->key.strValue,key) && 0!=strcmp(value,entry->value.strValue))
+		if(0==strcmp(entry->key.strValue,key))
 		{
-			free(entry->value.strValue);
-			entry->value.strValue = copystring(value);
+			freevalue(table,entry);
+			setstring(table,entry,value,packed);
 			return HASHREPLACEDVALUE;
 		}
 		// move to next entry
@@ -136,21 +3033,33 @@ HASHRESULT add_str_by_str( jwHashTable *table, char *key, char *value )
 	
 	// create a new entry and add at head of bucket
 	HASH_DEBUG("creating new entry\n");
-	entry = (jwHashEntry *)malloc(sizeof(jwHashEntry));
+	entry = newentry(table);
 	HASH_DEBUG("new entry: %x\n",entry);
 	entry->key.strValue = copystring(key);
-	entry->valtag = HASHSTRING;
-	entry->value.strValue = copystring(value);
+	entry->keytag = HASHKEYSTR;
+	setstring(table,entry,value,packed);
+	if(table->filter)
+		filteradd(table->filter,keyhash);
 	entry->next = table->bucket[hash];
 	table->bucket[hash] = entry;
+	if(table->index)
+		indexadd(table->index,entry);
 	HASH_DEBUG("added entry\n");
 	return HASHOK;
 }
 
 HASHRESULT add_dbl_by_str( jwHashTable *table, char *key, double value )
 {
+	if(table->shared) {
+		jwHashEntry item = { .valtag = HASHNUMERIC, .value.dblValue = value };
+		return sharedadd(table,hashString(key),HASHKEYSTR,key,0,&item);
+	}
+	if(table->frozen)
+		return HASHFROZEN;
+
 	// compute hash on key
-	size_t hash = hashString(key) % table->buckets;
+	long int keyhash = hashString(key);
+	size_t hash = keyhash % table->buckets;
 	HASH_DEBUG("adding %s -> %f hash: %ld\n",key,value,hash);
 
 	// add entry
@@ -161,6 +3070,9 @@ HASHRESULT add_dbl_by_str( jwHashTable *table, char *key, double value )
 	while(entry!=0)
 	{
 		HASH_DEBUG("checking entry: %x\n",entry);
+		// keys holding several values only change through add_multi_*
+		if(0==strcmp(entry->key.strValue,key) && entry->valtag==HASHMULTI)
+			return HASHALREADYADDED;
 		// check for already indexed
 		if(0==strcmp(entry->key.strValue,key) && value==entry->value.dblValue)
 			return HASHALREADYADDED;
@@ -176,23 +3088,37 @@ HASHRESULT add_dbl_by_str( jwHashTable *table, char *key, double value )
 	
 	// create a new entry and add at head of bucket
 	HASH_DEBUG("creating new entry\n");
-	entry = (jwHashEntry *)malloc(sizeof(jwHashEntry));
+	entry = newentry(table);
 	HASH_DEBUG("new entry: %x\n",entry);
 	entry->key.strValue = copystring(key);
+	entry->keytag = HASHKEYSTR;
 	entry->valtag = HASHNUMERIC;
 	entry->value.dblValue = value;
+	if(table->filter)
+		filteradd(table->filter,keyhash);
 	entry->next = table->bucket[hash];
 	table->bucket[hash] = entry;
+	if(table->index)
+		indexadd(table->index,entry);
 	HASH_DEBUG("added entry\n");
 	return HASHOK;
 }
 
 HASHRESULT add_int_by_str( jwHashTable *table, char *key, long int value )
 {
+	if(table->shared) {
+		jwHashEntry item = { .valtag = HASHNUMERIC };	// zeroes all of value first
+		item.value.intValue = value;
+		return sharedadd(table,hashString(key),HASHKEYSTR,key,0,&item);
+	}
+	if(table->frozen)
+		return HASHFROZEN;
+
 	// compute hash on key
-	size_t hash = hashString(key);
-	hash %= table->buckets;
+	long int keyhash = hashString(key);
+	size_t hash = keyhash % table->buckets;
 	HASH_DEBUG("adding %s -> %d hash: %ld\n",key,value,hash);
+	HASHRESULT result = HASHOK;
 
 #ifdef HASHTHREADED
 	// lock this bucket against changes
@@ -211,14 +3137,19 @@ HASHRESULT add_int_by_str( jwHashTable *table, char *key, long int value )
 	while(entry!=0)
 	{
 		HASH_DEBUG("checking entry: %x\n",entry);
+		// keys holding several values only change through add_multi_*
 		// check for already indexed
-		if(0==strcmp(entry->key.strValue,key) && value==entry->value.intValue)
-			return HASHALREADYADDED;
+		if(0==strcmp(entry->key.strValue,key) && (entry->valtag==HASHMULTI || value==entry->value.intValue))
+		{
+			result = HASHALREADYADDED;
+			goto unlock;
+		}
 		// check for replacing entry
 		if(0==strcmp(entry->key.strValue,key) && value!=entry->value.intValue)
 		{
 			entry->value.intValue = value;
-			return HASHREPLACEDVALUE;
+			result = HASHREPLACEDVALUE;
+			goto unlock;
 		}
 		// move to next entry
 		entry = entry->next;
@@ -226,26 +3157,39 @@ HASHRESULT add_int_by_str( jwHashTable *table, char *key, long int value )
 	
 	// create a new entry and add at head of bucket
 	HASH_DEBUG("creating new entry\n");
-	entry = (jwHashEntry *)malloc(sizeof(jwHashEntry));
+	entry = newentry(table);
 	HASH_DEBUG("new entry: %x\n",entry);
 	entry->key.strValue = copystring(key);
+	entry->keytag = HASHKEYSTR;
 	entry->valtag = HASHNUMERIC;
 	entry->value.intValue = value;
+	if(table->filter)
+		filteradd(table->filter,keyhash);
 	entry->next = table->bucket[hash];
 	table->bucket[hash] = entry;
+	if(table->index)
+		indexadd(table->index,entry);
 	HASH_DEBUG("added entry\n");
 unlock:
 #ifdef HASHTHREADED
 	__sync_synchronize(); // memory barrier
 	table->locks[hash] = 0;
 #endif
-	return HASHOK;
+	return result;
 }
 
 HASHRESULT add_ptr_by_str( jwHashTable *table, char *key, void *ptr )
 {
+	if(table->shared) {
+		jwHashEntry item = { .valtag = HASHPTR, .value.ptrValue = ptr };
+		return sharedadd(table,hashString(key),HASHKEYSTR,key,0,&item);
+	}
+	if(table->frozen)
+		return HASHFROZEN;
+
 	// compute hash on key
-	size_t hash = hashString(key) % table->buckets;
+	long int keyhash = hashString(key);
+	size_t hash = keyhash % table->buckets;
 	HASH_DEBUG("adding %s -> %x hash: %ld\n",key,ptr,hash);
 
 	// add entry
@@ -256,6 +3200,9 @@ HASHRESULT add_ptr_by_str( jwHashTable *table, char *key, void *ptr )
 	while(entry!=0)
 	{
 		HASH_DEBUG("checking entry: %x\n",entry);
+		// keys holding several values only change through add_multi_*
+		if(0==strcmp(entry->key.strValue,key) && entry->valtag==HASHMULTI)
+			return HASHALREADYADDED;
 		// check for already indexed
 		if(0==strcmp(entry->key.strValue,key) && ptr==entry->value.ptrValue)
 			return HASHALREADYADDED;
@@ -271,13 +3218,18 @@ HASHRESULT add_ptr_by_str( jwHashTable *table, char *key, void *ptr )
 	
 	// create a new entry and add at head of bucket
 	HASH_DEBUG("creating new entry\n");
-	entry = (jwHashEntry *)malloc(sizeof(jwHashEntry));
+	entry = newentry(table);
 	HASH_DEBUG("new entry: %x\n",entry);
 	entry->key.strValue = copystring(key);
+	entry->keytag = HASHKEYSTR;
 	entry->valtag = HASHPTR;
 	entry->value.ptrValue = ptr;
+	if(table->filter)
+		filteradd(table->filter,keyhash);
 	entry->next = table->bucket[hash];
 	table->bucket[hash] = entry;
+	if(table->index)
+		indexadd(table->index,entry);
 	HASH_DEBUG("added entry\n");
 	return HASHOK;
 }
@@ -285,8 +3237,14 @@ HASHRESULT add_ptr_by_str( jwHashTable *table, char *key, void *ptr )
 // Delete by string
 HASHRESULT del_by_str( jwHashTable *table, char *key )
 {
+	if(table->shared)
+		return shareddel(table,hashString(key),HASHKEYSTR,key,0);
+	if(table->frozen)
+		return HASHFROZEN;
+
 	// compute hash on key
-	size_t hash = hashString(key) % table->buckets;
+	long int keyhash = hashString(key);
+	size_t hash = keyhash % table->buckets;
 	HASH_DEBUG("deleting: %s hash: %ld\n",key,hash);
 
 	// add entry
@@ -306,11 +3264,14 @@ HASHRESULT del_by_str( jwHashTable *table, char *key )
 				table->bucket[hash] = entry->next;
 			else
 				previous->next = entry->next;
+			if(table->index)
+				indexdel(table->index,entry);
 			// delete string value if needed
-			if( entry->valtag==HASHSTRING )
-				free(entry->value.strValue);
-			free(entry->key.strValue);
-			free(entry);
+			freevalue(table,entry);
+			freestring(table,entry->key.strValue);
+			freeentry(table,entry);
+			if(table->filter)
+				filtercount(&table->filter->stale,1);
 			return HASHDELETED;
 		}
 		// move to next entry
@@ -323,10 +3284,27 @@ HASHRESULT del_by_str( jwHashTable *table, char *key )
 // Lookup str - keyed by str
 HASHRESULT get_str_by_str( jwHashTable *table, char *key, char **value )
 {
+	// a pointer into the segment isn't safe once the lock is dropped, use get_strbuf_*
+	if(table->shared)
+		return HASHSHARED;
+	if(table->frozen) {
+		jwHashSlot *slot = frozenfind_str(table->frozen,key);
+		if(!slot || slot->valtag==HASHMULTI)
+			return HASHNOTFOUND;
+		*value = slot->value.strValue;
+		return HASHOK;
+	}
+
 	// compute hash on key
-	size_t hash = hashString(key) % table->buckets;
+	long int keyhash = hashString(key);
+	size_t hash = keyhash % table->buckets;
 	HASH_DEBUG("fetching %s -> ?? hash: %d\n",key,hash);
 
+	// definite miss without touching the buckets
+	size_t started = 0;
+	if(table->filter && !filtertest(table->filter,keyhash,&started))
+		return HASHNOTFOUND;
+
 	// get entry
 	jwHashEntry *entry = table->bucket[hash];
 	
@@ -336,6 +3314,12 @@ HASHRESULT get_str_by_str( jwHashTable *table, char *key, char **value )
 		// check for key
 		HASH_DEBUG("found entry key: %d value: %s\n",entry->key.intValue,entry->value.strValue);
 		if(0==strcmp(entry->key.strValue,key)) {
+			if(entry->valtag==HASHMULTI)
+				return HASHNOTFOUND;
+			if(entry->valtag==HASHPACKED) {
+				*value = unpackvalue(table,entry);
+				return HASHOK;
+			}
 			*value =  entry->value.strValue;
 			return HASHOK;
 		}
@@ -344,16 +3328,39 @@ HASHRESULT get_str_by_str( jwHashTable *table, char *key, char **value )
 	}
 	
 	// not found
+	if(table->filter)
+		filtermiss(table->filter,started);
 	return HASHNOTFOUND;
 }
 
 // Lookup int - keyed by str
 HASHRESULT get_int_by_str( jwHashTable *table, char *key, int *i )
 {
+	if(table->shared) {
+		jwHashEntry item;
+		HASHRESULT result = sharedget(table,hashString(key),HASHKEYSTR,key,0,&item,NULL,0,NULL);
+		if(result==HASHOK)
+			*i = item.value.intValue;
+		return result;
+	}
+	if(table->frozen) {
+		jwHashSlot *slot = frozenfind_str(table->frozen,key);
+		if(!slot || slot->valtag==HASHMULTI)
+			return HASHNOTFOUND;
+		*i = slot->value.intValue;
+		return HASHOK;
+	}
+
 	// compute hash on key
-	size_t hash = hashString(key) % table->buckets;
+	long int keyhash = hashString(key);
+	size_t hash = keyhash % table->buckets;
 	HASH_DEBUG("fetching %s -> ?? hash: %d\n",key,hash);
 
+	// definite miss without touching the buckets
+	size_t started = 0;
+	if(table->filter && !filtertest(table->filter,keyhash,&started))
+		return HASHNOTFOUND;
+
 	// get entry
 	jwHashEntry *entry = table->bucket[hash];
 	
@@ -363,6 +3370,8 @@ HASHRESULT get_int_by_str( jwHashTable *table, char *key, int *i )
 		// check for key
 		HASH_DEBUG("found entry key: %s value: %ld\n",entry->key.strValue,entry->value.intValue);
 		if(0==strcmp(entry->key.strValue,key)) {
+			if(entry->valtag==HASHMULTI)
+				return HASHNOTFOUND;
 			*i = entry->value.intValue;
 			return HASHOK;
 		}
@@ -371,16 +3380,39 @@ HASHRESULT get_int_by_str( jwHashTable *table, char *key, int *i )
 	}
 	
 	// not found
+	if(table->filter)
+		filtermiss(table->filter,started);
 	return HASHNOTFOUND;
 }
 
 // Lookup dbl - keyed by str
 HASHRESULT get_dbl_by_str( jwHashTable *table, char *key, double *val )
 {
+	if(table->shared) {
+		jwHashEntry item;
+		HASHRESULT result = sharedget(table,hashString(key),HASHKEYSTR,key,0,&item,NULL,0,NULL);
+		if(result==HASHOK)
+			*val = item.value.dblValue;
+		return result;
+	}
+	if(table->frozen) {
+		jwHashSlot *slot = frozenfind_str(table->frozen,key);
+		if(!slot || slot->valtag==HASHMULTI)
+			return HASHNOTFOUND;
+		*val = slot->value.dblValue;
+		return HASHOK;
+	}
+
 	// compute hash on key
-	size_t hash = hashString(key) % table->buckets;
+	long int keyhash = hashString(key);
+	size_t hash = keyhash % table->buckets;
 	HASH_DEBUG("fetching %s -> ?? hash: %d\n",key,hash);
 
+	// definite miss without touching the buckets
+	size_t started = 0;
+	if(table->filter && !filtertest(table->filter,keyhash,&started))
+		return HASHNOTFOUND;
+
 	// get entry
 	jwHashEntry *entry = table->bucket[hash];
 	
@@ -390,6 +3422,8 @@ HASHRESULT get_dbl_by_str( jwHashTable *table, char *key, double *val )
 		// check for key
 		HASH_DEBUG("found entry key: %s value: %f\n",entry->key.strValue,entry->value.dblValue);
 		if(0==strcmp(entry->key.strValue,key)) {
+			if(entry->valtag==HASHMULTI)
+				return HASHNOTFOUND;
 			*val = entry->value.dblValue;
 			return HASHOK;
 		}
@@ -398,6 +3432,60 @@ HASHRESULT get_dbl_by_str( jwHashTable *table, char *key, double *val )
 	}
 	
 	// not found
+	if(table->filter)
+		filtermiss(table->filter,started);
+	return HASHNOTFOUND;
+}
+
+// Lookup ptr - keyed by str
+HASHRESULT get_ptr_by_str( jwHashTable *table, char *key, void **val )
+{
+	if(table->shared) {
+		jwHashEntry item;
+		HASHRESULT result = sharedget(table,hashString(key),HASHKEYSTR,key,0,&item,NULL,0,NULL);
+		if(result==HASHOK)
+			*val = item.value.ptrValue;
+		return result;
+	}
+	if(table->frozen) {
+		jwHashSlot *slot = frozenfind_str(table->frozen,key);
+		if(!slot || slot->valtag==HASHMULTI)
+			return HASHNOTFOUND;
+		*val = slot->value.ptrValue;
+		return HASHOK;
+	}
+
+	// compute hash on key
+	long int keyhash = hashString(key);
+	size_t hash = keyhash % table->buckets;
+	HASH_DEBUG("fetching %s -> ?? hash: %d\n",key,hash);
+
+	// definite miss without touching the buckets
+	size_t started = 0;
+	if(table->filter && !filtertest(table->filter,keyhash,&started))
+		return HASHNOTFOUND;
+
+	// get entry
+	jwHashEntry *entry = table->bucket[hash];
+	
+	// already an entry
+	while(entry)
+	{
+		// check for key
+		HASH_DEBUG("found entry key: %s value: %x\n",entry->key.strValue,entry->value.ptrValue);
+		if(0==strcmp(entry->key.strValue,key)) {
+			if(entry->valtag==HASHMULTI)
+				return HASHNOTFOUND;
+			*val = entry->value.ptrValue;
+			return HASHOK;
+		}
+		// move to next entry
+		entry = entry->next;
+	}
+	
+	// not found
+	if(table->filter)
+		filtermiss(table->filter,started);
 	return HASHNOTFOUND;
 }
 
@@ -407,10 +3495,21 @@ HASHRESULT get_dbl_by_str( jwHashTable *table, char *key, double *val )
 // Add to table - keyed by int
 HASHRESULT add_str_by_int( jwHashTable *table, long int key, char *value )
 {
+	if(table->shared) {
+		jwHashEntry item = { .valtag = HASHSTRING, .value.strValue = value };
+		return sharedadd(table,hashInt(key),HASHKEYINT,NULL,key,&item);
+	}
+	if(table->frozen)
+		return HASHFROZEN;
+
 	// compute hash on key
-	size_t hash = hashInt(key) % table->buckets;
+	long int keyhash = hashInt(key);
+	size_t hash = keyhash % table->buckets;
 	HASH_DEBUG("adding %d -> %s hash: %d\n",key,value,hash);
 
+	// compress up front, so an unchanged value can be spotted without decoding
+	jwHashPacked *packed = table->compress ? packstring(table->compress,value) : NULL;
+
 	// add entry
 	jwHashEntry *entry = table->bucket[hash];
 	
@@ -419,14 +3518,20 @@ HASHRESULT add_str_by_int( jwHashTable *table, long int key, char *value )
 	while(entry!=0)
 	{
 		HASH_DEBUG("checking entry: %x\n",entry);
+		// keys holding several values only change through add_multi_*
+		if(entry->key.intValue==key && entry->valtag==HASHMULTI)
+			return HASHALREADYADDED;
 		// check for already indexed
-		if(entry->key.intValue==key && 0==strcmp(value,entry->value.strValue))
+		if(entry->key.intValue==key && samestring(entry,value,packed))
+		{
+			free(packed);
 			return HASHALREADYADDED;
+		}
 		// check for replacing entry
-		if(entry->key.intValue==key && 0!=strcmp(value,entry->value.strValue))
+		if(entry->key.intValue==key)
 		{
-			free(entry->value.strValue);
-			entry->value.strValue = copystring(value);
+			freevalue(table,entry);
+			setstring(table,entry,value,packed);
 			return HASHREPLACEDVALUE;
 		}
 		// move to next entry
@@ -435,13 +3540,17 @@ HASHRESULT add_str_by_int( jwHashTable *table, long int key, char *value )
 	
 	// create a new entry and add at head of bucket
 	HASH_DEBUG("creating new entry\n");
-	entry = (jwHashEntry *)malloc(sizeof(jwHashEntry));
+	entry = newentry(table);
 	HASH_DEBUG("new entry: %x\n",entry);
 	entry->key.intValue = key;
-	entry->valtag = HASHSTRING;
-	entry->value.strValue = copystring(value);
+	entry->keytag = HASHKEYINT;
+	setstring(table,entry,value,packed);
+	if(table->filter)
+		filteradd(table->filter,keyhash);
 	entry->next = table->bucket[hash];
 	table->bucket[hash] = entry;
+	if(table->index)
+		indexadd(table->index,entry);
 	HASH_DEBUG("added entry\n");
 	return HASHOK;
 }
@@ -449,8 +3558,16 @@ HASHRESULT add_str_by_int( jwHashTable *table, long int key, char *value )
 // Add dbl to table - keyed by int
 HASHRESULT add_dbl_by_int( jwHashTable* table, long int key, double value )
 {
+	if(table->shared) {
+		jwHashEntry item = { .valtag = HASHNUMERIC, .value.dblValue = value };
+		return sharedadd(table,hashInt(key),HASHKEYINT,NULL,key,&item);
+	}
+	if(table->frozen)
+		return HASHFROZEN;
+
 	// compute hash on key
-	size_t hash = hashInt(key) % table->buckets;
+	long int keyhash = hashInt(key);
+	size_t hash = keyhash % table->buckets;
 	HASH_DEBUG("adding %d -> %f hash: %d\n",key,value,hash);
 
 	// add entry
@@ -461,6 +3578,9 @@ HASHRESULT add_dbl_by_int( jwHashTable* table, long int key, double value )
 	while(entry!=0)
 	{
 		HASH_DEBUG("checking entry: %x\n",entry);
+		// keys holding several values only change through add_multi_*
+		if(entry->key.intValue==key && entry->valtag==HASHMULTI)
+			return HASHALREADYADDED;
 		// check for already indexed
 		if(entry->key.intValue==key && value==entry->value.dblValue)
 			return HASHALREADYADDED;
@@ -476,21 +3596,35 @@ HASHRESULT add_dbl_by_int( jwHashTable* table, long int key, double value )
 	
 	// create a new entry and add at head of bucket
 	HASH_DEBUG("creating new entry\n");
-	entry = (jwHashEntry *)malloc(sizeof(jwHashEntry));
+	entry = newentry(table);
 	HASH_DEBUG("new entry: %x\n",entry);
 	entry->key.intValue = key;
+	entry->keytag = HASHKEYINT;
 	entry->valtag = HASHNUMERIC;
 	entry->value.dblValue = value;
+	if(table->filter)
+		filteradd(table->filter,keyhash);
 	entry->next = table->bucket[hash];
 	table->bucket[hash] = entry;
+	if(table->index)
+		indexadd(table->index,entry);
 	HASH_DEBUG("added entry\n");
 	return HASHOK;
 }
 
 HASHRESULT add_int_by_int( jwHashTable* table, long int key, long int value )
 {
+	if(table->shared) {
+		jwHashEntry item = { .valtag = HASHNUMERIC };	// zeroes all of value first
+		item.value.intValue = value;
+		return sharedadd(table,hashInt(key),HASHKEYINT,NULL,key,&item);
+	}
+	if(table->frozen)
+		return HASHFROZEN;
+
 	// compute hash on key
-	size_t hash = hashInt(key) % table->buckets;
+	long int keyhash = hashInt(key);
+	size_t hash = keyhash % table->buckets;
 	HASH_DEBUG("adding %d -> %d hash: %d\n",key,value,hash);
 
 	// add entry
@@ -501,6 +3635,9 @@ HASHRESULT add_int_by_int( jwHashTable* table, long int key, long int value )
 	while(entry!=0)
 	{
 		HASH_DEBUG("checking entry: %x\n",entry);
+		// keys holding several values only change through add_multi_*
+		if(entry->key.intValue==key && entry->valtag==HASHMULTI)
+			return HASHALREADYADDED;
 		// check for already indexed
 		if(entry->key.intValue==key && value==entry->value.intValue)
 			return HASHALREADYADDED;
@@ -516,13 +3653,18 @@ HASHRESULT add_int_by_int( jwHashTable* table, long int key, long int value )
 	
 	// create a new entry and add at head of bucket
 	HASH_DEBUG("creating new entry\n");
-	entry = (jwHashEntry *)malloc(sizeof(jwHashEntry));
+	entry = newentry(table);
 	HASH_DEBUG("new entry: %x\n",entry);
 	entry->key.intValue = key;
+	entry->keytag = HASHKEYINT;
 	entry->valtag = HASHNUMERIC;
 	entry->value.intValue = value;
+	if(table->filter)
+		filteradd(table->filter,keyhash);
 	entry->next = table->bucket[hash];
 	table->bucket[hash] = entry;
+	if(table->index)
+		indexadd(table->index,entry);
 	HASH_DEBUG("added entry\n");
 	return HASHOK;
 }
@@ -531,8 +3673,14 @@ HASHRESULT add_int_by_int( jwHashTable* table, long int key, long int value )
 // Delete by int
 HASHRESULT del_by_int( jwHashTable* table, long int key )
 {
+	if(table->shared)
+		return shareddel(table,hashInt(key),HASHKEYINT,NULL,key);
+	if(table->frozen)
+		return HASHFROZEN;
+
 	// compute hash on key
-	size_t hash = hashInt(key) % table->buckets;
+	long int keyhash = hashInt(key);
+	size_t hash = keyhash % table->buckets;
 	HASH_DEBUG("deleting: %d hash: %d\n",key,hash);
 
 	// add entry
@@ -552,10 +3700,13 @@ HASHRESULT del_by_int( jwHashTable* table, long int key )
 				table->bucket[hash] = entry->next;
 			else
 				prev->next = entry->next;
+			if(table->index)
+				indexdel(table->index,entry);
 			// delete string value if needed
-			if( entry->valtag==HASHSTRING )
-				free(entry->value.strValue);
-			free(entry);
+			freevalue(table,entry);
+			freeentry(table,entry);
+			if(table->filter)
+				filtercount(&table->filter->stale,1);
 			return HASHDELETED;
 		}
 		// move to next entry
@@ -568,10 +3719,27 @@ HASHRESULT del_by_int( jwHashTable* table, long int key )
 // Lookup str - keyed by int
 HASHRESULT get_str_by_int( jwHashTable *table, long int key, char **value )
 {
+	// a pointer into the segment isn't safe once the lock is dropped, use get_strbuf_*
+	if(table->shared)
+		return HASHSHARED;
+	if(table->frozen) {
+		jwHashSlot *slot = frozenfind_int(table->frozen,key);
+		if(!slot || slot->valtag==HASHMULTI)
+			return HASHNOTFOUND;
+		*value = slot->value.strValue;
+		return HASHOK;
+	}
+
 	// compute hash on key
-	size_t hash = hashInt(key) % table->buckets;
+	long int keyhash = hashInt(key);
+	size_t hash = keyhash % table->buckets;
 	HASH_DEBUG("fetching %d -> ?? hash: %d\n",key,hash);
 
+	// definite miss without touching the buckets
+	size_t started = 0;
+	if(table->filter && !filtertest(table->filter,keyhash,&started))
+		return HASHNOTFOUND;
+
 	// get entry
 	jwHashEntry *entry = table->bucket[hash];
 	
@@ -581,6 +3749,12 @@ HASHRESULT get_str_by_int( jwHashTable *table, long int key, char **value )
 		// check for key
 		HASH_DEBUG("found entry key: %d value: %s\n",entry->key.intValue,entry->value.strValue);
 		if(entry->key.intValue==key) {
+			if(entry->valtag==HASHMULTI)
+				return HASHNOTFOUND;
+			if(entry->valtag==HASHPACKED) {
+				*value = unpackvalue(table,entry);
+				return HASHOK;
+			}
 			*value = entry->value.strValue;
 			return HASHOK;
 		}
@@ -589,11 +3763,398 @@ HASHRESULT get_str_by_int( jwHashTable *table, long int key, char **value )
 	}
 	
 	// not found
+	if(table->filter)
+		filtermiss(table->filter,started);
 	return HASHNOTFOUND;
 }
 
+// Lookup int - keyed by int
+HASHRESULT get_int_by_int( jwHashTable *table, long int key, int *i )
+{
+	if(table->shared) {
+		jwHashEntry item;
+		HASHRESULT result = sharedget(table,hashInt(key),HASHKEYINT,NULL,key,&item,NULL,0,NULL);
+		if(result==HASHOK)
+			*i = item.value.intValue;
+		return result;
+	}
+	if(table->frozen) {
+		jwHashSlot *slot = frozenfind_int(table->frozen,key);
+		if(!slot || slot->valtag==HASHMULTI)
+			return HASHNOTFOUND;
+		*i = slot->value.intValue;
+		return HASHOK;
+	}
+
+	// compute hash on key
+	long int keyhash = hashInt(key);
+	size_t hash = keyhash % table->buckets;
+	HASH_DEBUG("fetching %d -> ?? hash: %d\n",key,hash);
+
+	// definite miss without touching the buckets
+	size_t started = 0;
+	if(table->filter && !filtertest(table->filter,keyhash,&started))
+		return HASHNOTFOUND;
+
+	// get entry
+	jwHashEntry *entry = table->bucket[hash];
+	
+	// already an entry
+	while(entry)
+	{
+		// check for key
+		HASH_DEBUG("found entry key: %d value: %ld\n",entry->key.intValue,entry->value.intValue);
+		if(entry->key.intValue==key) {
+			if(entry->valtag==HASHMULTI)
+				return HASHNOTFOUND;
+			*i = entry->value.intValue;
+			return HASHOK;
+		}
+		// move to next entry
+		entry = entry->next;
+	}
+	
+	// not found
+	if(table->filter)
+		filtermiss(table->filter,started);
+	return HASHNOTFOUND;
+}
+
+// Lookup dbl - keyed by int
+HASHRESULT get_dbl_by_int( jwHashTable *table, long int key, double *val )
+{
+	if(table->shared) {
+		jwHashEntry item;
+		HASHRESULT result = sharedget(table,hashInt(key),HASHKEYINT,NULL,key,&item,NULL,0,NULL);
+		if(result==HASHOK)
+			*val = item.value.dblValue;
+		return result;
+	}
+	if(table->frozen) {
+		jwHashSlot *slot = frozenfind_int(table->frozen,key);
+		if(!slot || slot->valtag==HASHMULTI)
+			return HASHNOTFOUND;
+		*val = slot->value.dblValue;
+		return HASHOK;
+	}
+
+	// compute hash on key
+	long int keyhash = hashInt(key);
+	size_t hash = keyhash % table->buckets;
+	HASH_DEBUG("fetching %d -> ?? hash: %d\n",key,hash);
+
+	// definite miss without touching the buckets
+	size_t started = 0;
+	if(table->filter && !filtertest(table->filter,keyhash,&started))
+		return HASHNOTFOUND;
+
+	// get entry
+	jwHashEntry *entry = table->bucket[hash];
+	
+	// already an entry
+	while(entry)
+	{
+		// check for key
+		HASH_DEBUG("found entry key: %d value: %f\n",entry->key.intValue,entry->value.dblValue);
+		if(entry->key.intValue==key) {
+			if(entry->valtag==HASHMULTI)
+				return HASHNOTFOUND;
+			*val = entry->value.dblValue;
+			return HASHOK;
+		}
+		// move to next entry
+		entry = entry->next;
+	}
+	
+	// not found
+	if(table->filter)
+		filtermiss(table->filter,started);
+	return HASHNOTFOUND;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// MULTIPLE VALUES PER KEY
+
+// A multi entry keeps all of a key's values in the same allocation as the
+// entry. It's realloc'd as it grows and relinked in place, with the bucket
+// locked. The single value add_* refuse a multi key with HASHALREADYADDED and
+// get_* report it as HASHNOTFOUND, the same way add_multi_* refuses theirs.
+
+#define HASHMULTIINITIAL	4
+
+// find the link to key's entry, or the empty link at the end of its chain
+static inline jwHashEntry **multilink(jwHashEntry **link, HASHKEYTAG keytag, char *strkey, long int intkey)
+{
+	while(*link) {
+		jwHashEntry *entry = *link;
+		if(entry->keytag==keytag && (keytag==HASHKEYSTR ? 0==strcmp(entry->key.strValue,strkey) : entry->key.intValue==intkey))
+			break;
+		link = &entry->next;
+	}
+	return link;
+}
+
+static HASHRESULT multiappend(jwHashTable *table, long int keyhash, HASHKEYTAG keytag, char *strkey, long int intkey, long int value)
+{
+	jwHashEntry **link = multilink(&table->bucket[keyhash % table->buckets],keytag,strkey,intkey);
+	jwHashMulti *multi;
+	HASHRESULT result = HASHADDED;
+
+	if(!*link) {
+		// new key, link it at the end of the chain
+		multi = (jwHashMulti *)malloc(sizeof(jwHashMulti)+(HASHMULTIINITIAL-1)*sizeof(long int));
+		if(!multi) {
+			printf("Unable to allocate multi entry\n");
+			abort();
+		}
+		multi->entry.keytag = keytag;
+		if(keytag==HASHKEYSTR)
+			multi->entry.key.strValue = copystring(strkey);
+		else
+			multi->entry.key.intValue = intkey;
+		multi->entry.valtag = HASHMULTI;
+		multi->entry.next = NULL;
+		multi->count = 0;
+		multi->capacity = HASHMULTIINITIAL;
+		*link = &multi->entry;
+		if(table->filter)
+			filteradd(table->filter,keyhash);
+		if(table->index)
+			indexadd(table->index,&multi->entry);
+		result = HASHOK;
+	} else if((*link)->valtag!=HASHMULTI) {
+		return HASHALREADYADDED;
+	} else {
+		multi = (jwHashMulti *)*link;
+		if(multi->count==multi->capacity) {
+			jwHashIndexNode *leaf = NULL;
+			int pos = 0;
+			if(table->index)
+				leaf = indexmoving(table->index,&multi->entry,&pos);
+			multi = (jwHashMulti *)realloc(multi,sizeof(jwHashMulti)+(2*multi->capacity-1)*sizeof(long int));
+			if(!multi) {
+				printf("Unable to grow multi entry\n");
+				abort();
+			}
+			if(table->index)
+				indexmoved(table->index,leaf,pos,&multi->entry);
+			multi->capacity *= 2;
+			*link = &multi->entry;
+		}
+	}
+	multi->values[multi->count++] = value;
+	multi->entry.value.ptrValue = multi->values;
+	return result;
+}
+
+static HASHRESULT multiremove(jwHashTable *table, long int keyhash, HASHKEYTAG keytag, char *strkey, long int intkey, long int value)
+{
+	jwHashEntry **link = multilink(&table->bucket[keyhash % table->buckets],keytag,strkey,intkey);
+	jwHashMulti *multi;
+	size_t i;
+
+	if(!*link || (*link)->valtag!=HASHMULTI)
+		return HASHNOTFOUND;
+	multi = (jwHashMulti *)*link;
+	for(i=0;i<multi->count;++i)
+		if(multi->values[i]==value)
+			break;
+	if(i==multi->count)
+		return HASHNOTFOUND;
+	// keep the remaining values in order
+	memmove(&multi->values[i],&multi->values[i+1],(multi->count-i-1)*sizeof(long int));
+	if(--multi->count)
+		return HASHDELETED;
+
+	// last value gone, remove the key
+	*link = multi->entry.next;
+	if(table->index)
+		indexdel(table->index,&multi->entry);
+	if(keytag==HASHKEYSTR)
+		freestring(table,multi->entry.key.strValue);
+	free(multi);
+	if(table->filter)
+		filtercount(&table->filter->stale,1);
+	return HASHDELETED;
+}
+
+// the above with the key's bucket locked
+static HASHRESULT multiadd(jwHashTable *table, long int keyhash, HASHKEYTAG keytag, char *strkey, long int intkey, long int value)
+{
+	HASHRESULT result;
+#ifdef HASHTHREADED
+	lockbucket(table,keyhash % table->buckets);
+#endif
+	result = multiappend(table,keyhash,keytag,strkey,intkey,value);
+#ifdef HASHTHREADED
+	unlockbucket(table,keyhash % table->buckets);
+#endif
+	return result;
+}
+
+static HASHRESULT multidel(jwHashTable *table, long int keyhash, HASHKEYTAG keytag, char *strkey, long int intkey, long int value)
+{
+	HASHRESULT result;
+#ifdef HASHTHREADED
+	lockbucket(table,keyhash % table->buckets);
+#endif
+	result = multiremove(table,keyhash,keytag,strkey,intkey,value);
+#ifdef HASHTHREADED
+	unlockbucket(table,keyhash % table->buckets);
+#endif
+	return result;
+}
+
+static HASHRESULT multiget(jwHashTable *table, long int keyhash, HASHKEYTAG keytag, char *strkey, long int intkey, long int **values, size_t *count)
+{
+	jwHashEntry **link;
+	size_t started = 0;
+	if(table->filter && !filtertest(table->filter,keyhash,&started))
+		return HASHNOTFOUND;
+	link = multilink(&table->bucket[keyhash % table->buckets],keytag,strkey,intkey);
+	if(!*link) {
+		if(table->filter)
+			filtermiss(table->filter,started);
+		return HASHNOTFOUND;
+	}
+	if((*link)->valtag!=HASHMULTI)
+		return HASHNOTFOUND;
+	*values = ((jwHashMulti *)*link)->values;
+	*count = ((jwHashMulti *)*link)->count;
+	return HASHOK;
+}
+
+// frozen multi values are preceded by their count
+static inline HASHRESULT multifrozen(jwHashSlot *slot, long int **values, size_t *count)
+{
+	if(!slot || slot->valtag!=HASHMULTI)
+		return HASHNOTFOUND;
+	*values = (long int *)slot->value.ptrValue;
+	*count = (size_t)(*values)[-1];
+	return HASHOK;
+}
 
+// Append a value to a key's values - keyed by string
+HASHRESULT add_multi_by_str( jwHashTable *table, char *key, long int value )
+{
+	if(table->shared)
+		return HASHSHARED;
+	if(table->frozen)
+		return HASHFROZEN;
+	return multiadd(table,hashString(key),HASHKEYSTR,key,0,value);
+}
+
+// Remove one value from a key's values, and the key once it has none left
+HASHRESULT del_multi_by_str( jwHashTable *table, char *key, long int value )
+{
+	if(table->shared)
+		return HASHSHARED;
+	if(table->frozen)
+		return HASHFROZEN;
+	return multidel(table,hashString(key),HASHKEYSTR,key,0,value);
+}
+
+// Get all of a key's values, valid until the key is next changed
+HASHRESULT get_multi_by_str( jwHashTable *table, char *key, long int **values, size_t *count )
+{
+	if(table->shared)
+		return HASHSHARED;
+	if(table->frozen)
+		return multifrozen(frozenfind_str(table->frozen,key),values,count);
+	return multiget(table,hashString(key),HASHKEYSTR,key,0,values,count);
+}
+
+// Append a value to a key's values - keyed by int
+HASHRESULT add_multi_by_int( jwHashTable *table, long int key, long int value )
+{
+	if(table->shared)
+		return HASHSHARED;
+	if(table->frozen)
+		return HASHFROZEN;
+	return multiadd(table,hashInt(key),HASHKEYINT,NULL,key,value);
+}
+
+HASHRESULT del_multi_by_int( jwHashTable *table, long int key, long int value )
+{
+	if(table->shared)
+		return HASHSHARED;
+	if(table->frozen)
+		return HASHFROZEN;
+	return multidel(table,hashInt(key),HASHKEYINT,NULL,key,value);
+}
+
+HASHRESULT get_multi_by_int( jwHashTable *table, long int key, long int **values, size_t *count )
+{
+	if(table->shared)
+		return HASHSHARED;
+	if(table->frozen)
+		return multifrozen(frozenfind_int(table->frozen,key),values,count);
+	return multiget(table,hashInt(key),HASHKEYINT,NULL,key,values,count);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// GETTING STRING VALUES INTO A BUFFER
+//
+// Works for plain and compressed values alike. If the value and its terminator
+// don't fit in size bytes nothing is copied, check *length < size, as with
+// snprintf, and call again with a bigger buffer.
 
+static HASHRESULT strbufcopy(jwHashTable *table, jwHashEntry *entry, char *buf, size_t size, size_t *length)
+{
+	if(!entry || (entry->valtag!=HASHSTRING && entry->valtag!=HASHPACKED))
+		return HASHNOTFOUND;
+	*length = stringlength(entry)-1;
+	if(*length<size)
+		copyvalue(table,entry,buf);
+	return HASHOK;
+}
 
+// frozen values are never compressed
+static HASHRESULT strbufslot(jwHashSlot *slot, char *buf, size_t size, size_t *length)
+{
+	if(!slot || slot->valtag!=HASHSTRING)
+		return HASHNOTFOUND;
+	*length = strlen(slot->value.strValue);
+	if(*length<size)
+		memcpy(buf,slot->value.strValue,*length+1);
+	return HASHOK;
+}
 
+// Copy out a string value - keyed by string
+HASHRESULT get_strbuf_by_str( jwHashTable *table, char *key, char *buf, size_t size, size_t *length )
+{
+	if(table->shared) {
+		jwHashEntry item;
+		return sharedget(table,hashString(key),HASHKEYSTR,key,0,&item,buf,size,length);
+	}
+	if(table->frozen)
+		return strbufslot(frozenfind_str(table->frozen,key),buf,size,length);
+	long int keyhash = hashString(key);
+	size_t started = 0;
+	if(table->filter && !filtertest(table->filter,keyhash,&started))
+		return HASHNOTFOUND;
+	jwHashEntry *entry = *multilink(&table->bucket[keyhash % table->buckets],HASHKEYSTR,key,0);
+	if(!entry && table->filter)
+		filtermiss(table->filter,started);
+	return strbufcopy(table,entry,buf,size,length);
+}
 
+// Copy out a string value - keyed by int
+HASHRESULT get_strbuf_by_int( jwHashTable *table, long int key, char *buf, size_t size, size_t *length )
+{
+	if(table->shared) {
+		jwHashEntry item;
+		return sharedget(table,hashInt(key),HASHKEYINT,NULL,key,&item,buf,size,length);
+	}
+	if(table->frozen)
+		return strbufslot(frozenfind_int(table->frozen,key),buf,size,length);
+	long int keyhash = hashInt(key);
+	size_t started = 0;
+	if(table->filter && !filtertest(table->filter,keyhash,&started))
+		return HASHNOTFOUND;
+	jwHashEntry *entry = *multilink(&table->bucket[keyhash % table->buckets],HASHKEYINT,NULL,key);
+	if(!entry && table->filter)
+		filtermiss(table->filter,started);
+	return strbufcopy(table,entry,buf,size,length);
+}
@@ -40,6 +40,13 @@ typedef enum
 	HASHALREADYADDED,
 	HASHDELETED,
 	HASHNOTFOUND,
+	HASHFROZEN,
+	HASHCOMPRESSED,					// stream result for a compressed value, use get_strbuf_*
+	HASHNOINDEX,					// scan_* need enable_index first
+	HASHNOSPACE,					// shared segment is full
+	HASHSHARED,						// not supported on a shared table
+	HASHFREEZEFAILED,				// no perfect hash found, the table is left as it was
+	HASHMULTIPLE,					// key holds several values, use get_multi_*
 } HASHRESULT;
 
 typedef enum
@@ -47,8 +54,26 @@ typedef enum
 	HASHPTR,
 	HASHNUMERIC,
 	HASHSTRING,
+	HASHMULTI,						// several long int values, see add_multi_by_str
+	HASHPACKED,						// compressed string value, see enable_compression
 } HASHVALTAG;
-	
+
+typedef enum
+{
+	HASHKEYSTR,
+	HASHKEYINT,
+} HASHKEYTAG;
+
+// flags for create_hash_mem
+#define HASHMEMHUGE			1		// back buckets, locks and entries with transparent 2 MiB pages
+#define HASHMEMHUGETLB		2		// use reserved hugetlbfs pages, falling back to HASHMEMHUGE
+#define HASHMEMBIND			4		// keep all of it on one NUMA node
+#define HASHMEMINTERLEAVE	8		// spread it page by page across NUMA nodes
+#define HASHMAXNODES		1024	// HASHMEMBIND takes nodes 0 to HASHMAXNODES-1
+
+// flags for build_hash_from_array
+#define HASHBUILDUNIQUE		1		// caller guarantees keys are unique, skip duplicate checks
+
 
 typedef struct jwHashEntry jwHashEntry;
 struct jwHashEntry
@@ -60,6 +85,7 @@ struct jwHashEntry
 		int	   intValue;
 	} key;
 	HASHVALTAG valtag;
+	HASHKEYTAG keytag;				// fits in the padding after valtag
 	union
 	{
 		char  *strValue;
@@ -70,6 +96,94 @@ struct jwHashEntry
 	jwHashEntry *next;
 };
 
+// key/value pair for bulk loading
+typedef struct jwHashPair jwHashPair;
+struct jwHashPair
+{
+	union
+	{
+		char  *strValue;
+		double dblValue;
+		int	   intValue;
+	} key;
+	HASHVALTAG valtag;
+	union
+	{
+		char  *strValue;
+		double dblValue;
+		int	   intValue;
+		void  *ptrValue;
+	} value;
+};
+
+// block of pooled entries, see create_hash_mem
+typedef struct jwHashChunk jwHashChunk;
+
+// immutable perfect hash form of a table, see freeze_hash
+typedef struct jwHashFrozen jwHashFrozen;
+
+// negative lookup filter, see enable_filter
+typedef struct jwHashFilter jwHashFilter;
+
+typedef struct jwHashFilterStats jwHashFilterStats;
+struct jwHashFilterStats
+{
+	size_t bytes;					// size of the filter
+	size_t capacity;				// keys it was sized for
+	size_t keys;					// keys added, including stale ones
+	size_t stale;					// keys deleted since it was built, rebuild with enable_filter
+	size_t lookups;					// get_* calls that checked the filter, see enable_filter_stats
+	size_t rejected;				// definite misses answered by the filter alone
+	size_t falsepositives;			// passed the filter but weren't in the table
+	double fprate;					// falsepositives / all misses
+	double missns;					// average nanoseconds spent in a get_* miss
+};
+
+// shared dictionary and counters for compressed values, see enable_compression
+typedef struct jwHashCompress jwHashCompress;
+
+typedef struct jwHashCompressStats jwHashCompressStats;
+struct jwHashCompressStats
+{
+	size_t values;					// string values stored compressed
+	size_t rawbytes;				// their size uncompressed, with terminators
+	size_t storedbytes;				// their size as stored, with headers
+	size_t decodedbytes;			// plain copies kept for get_str_*, with terminators
+	size_t dictbytes;				// size of the shared dictionary
+};
+
+// ordered index for range scans, see enable_index
+typedef struct jwHashIndex jwHashIndex;
+
+// this process's mapping of a shared table, see create_shared_hash
+typedef struct jwHashShared jwHashShared;
+
+typedef struct jwHashSharedStats jwHashSharedStats;
+struct jwHashSharedStats
+{
+	size_t bytes;					// size of the segment
+	size_t used;					// high water mark, freed blocks are reused below it
+	size_t entries;					// keys in the table
+};
+
+// interleaved lookups, see create_stream
+typedef struct jwHashStream jwHashStream;
+
+typedef struct jwHashStreamResult jwHashStreamResult;
+struct jwHashStreamResult
+{
+	void *tag;						// as passed to stream_feed_*
+	HASHRESULT result;				// HASHOK, HASHNOTFOUND, HASHMULTIPLE or HASHCOMPRESSED
+	HASHVALTAG valtag;				// value is only set for HASHOK
+	union
+	{
+		char  *strValue;
+		double dblValue;
+		int	   intValue;
+		void  *ptrValue;
+	} value;
+};
+
 typedef struct jwHashTable jwHashTable;
 struct jwHashTable
 {
@@ -77,6 +191,22 @@ struct jwHashTable
 	size_t buckets;
 	size_t bucketsinitial;			// if we resize, may need to hash multiple times
 	HASHRESULT lastError;
+	jwHashEntry *entries;			// contiguous entries from a bulk build, or NULL
+	size_t entrycount;
+	jwHashEntry *freelist;			// deleted bulk entries, reused by add_*
+	char *strings;					// contiguous key/value strings from a bulk build, or NULL
+	size_t stringsize;
+	jwHashFrozen *frozen;			// set once frozen, add_* and del_* then return HASHFROZEN
+	jwHashFilter *filter;			// checked by get_* before the buckets, or NULL
+	jwHashCompress *compress;		// set once string values are compressed, or NULL
+	jwHashIndex *index;				// sorted view of the entries for scan_*, or NULL
+	jwHashShared *shared;			// set if the table lives in shared memory, bucket is then unused
+	int memflags;					// HASHMEM* flags from create_hash_mem
+	int memnode;					// NUMA node for HASHMEMBIND
+	int memmissed;					// HASHMEM* flags that fell back to plain pages somewhere
+	jwHashChunk *chunks;			// entry storage when memflags are set
+	size_t chunkleft;				// entries not yet handed out from the newest chunk
+	size_t spilled;					// entries malloc'd because a chunk couldn't be mapped
 #ifdef HASHTHREADED
 	volatile int *locks;			// array of locks
 	volatile int lock;				// lock for entire table
@@ -85,8 +215,49 @@ struct jwHashTable
 
 // Create/delete hash table
 jwHashTable *create_hash( size_t buckets );
+jwHashTable *create_hash_mem( size_t buckets, int memflags, int node );
 void *delete_hash( jwHashTable *table );		// clean up all memory
 
+// Tables in shared memory, for several processes to use one copy
+// get_str_* return HASHSHARED on them, read strings with get_strbuf_*
+jwHashTable *create_shared_hash( const char *name, size_t buckets, size_t bytes );
+jwHashTable *attach_shared_hash( const char *name );
+HASHRESULT unlink_shared_hash( const char *name );
+HASHRESULT get_shared_stats( jwHashTable *table, jwHashSharedStats *stats );
+
+// Create a table sized for count pairs and load them in one pass
+jwHashTable *build_hash_from_array( jwHashPair *pairs, size_t count, HASHKEYTAG keytag, int flags );
+
+// Convert to a read-only minimal perfect hash, get_* still work
+HASHRESULT freeze_hash( jwHashTable *table );
+HASHRESULT save_frozen_hash( jwHashTable *table, const char *path );
+jwHashTable *load_frozen_hash( const char *path );
+
+// Bloom filter in front of the buckets, so most misses cost one cache line
+HASHRESULT enable_filter( jwHashTable *table, size_t keys, int bitsperkey );
+HASHRESULT disable_filter( jwHashTable *table );
+HASHRESULT enable_filter_stats( jwHashTable *table );
+HASHRESULT get_filter_stats( jwHashTable *table, jwHashFilterStats *stats );
+
+// Many lookups in flight from one thread, so their cache misses overlap
+jwHashStream *create_stream( jwHashTable *table, int width );
+void *delete_stream( jwHashStream *stream );
+int stream_feed_str( jwHashStream *stream, char *key, void *tag );
+int stream_feed_int( jwHashStream *stream, long int key, void *tag );
+int stream_next( jwHashStream *stream, jwHashStreamResult *result );
+
+// Compress long string values, optionally primed with a dictionary of typical content.
+// Read them with get_strbuf_*, which decodes into your buffer; see get_str_* below.
+HASHRESULT enable_compression( jwHashTable *table, char *dict, size_t dictlen );
+HASHRESULT get_compression_stats( jwHashTable *table, jwHashCompressStats *stats );
+
+// Keep keys in order as well, for prefix and range scans; fn returns non-zero to stop
+typedef int (*jwHashScanFunc)( jwHashEntry *entry, void *arg );
+HASHRESULT enable_index( jwHashTable *table );
+HASHRESULT disable_index( jwHashTable *table );
+HASHRESULT scan_prefix_by_str( jwHashTable *table, char *prefix, jwHashScanFunc fn, void *arg );
+HASHRESULT scan_range_by_int( jwHashTable *table, long int lo, long int hi, jwHashScanFunc fn, void *arg );
+
 
 // Add to table - keyed by string
 HASHRESULT add_str_by_str( jwHashTable*, char *key, char *value );
@@ -98,10 +269,21 @@ HASHRESULT add_ptr_by_str( jwHashTable*, char *key, void *value );
 HASHRESULT del_by_str( jwHashTable*, char *key );
 
 // Get by string
+// NOTE: on a compressed table get_str_* keep a decoded copy of each value they
+// return, alongside the compressed one until the value is replaced or deleted,
+// which gives back the memory compression saved. Use get_strbuf_* there.
+// On a shared table get_str_* return HASHSHARED, use get_strbuf_*.
 HASHRESULT get_str_by_str( jwHashTable *table, char *key, char **value );
 HASHRESULT get_int_by_str( jwHashTable *table, char *key, int *i );
 HASHRESULT get_dbl_by_str( jwHashTable *table, char *key, double *val );
+HASHRESULT get_ptr_by_str( jwHashTable *table, char *key, void **val );
+HASHRESULT get_strbuf_by_str( jwHashTable *table, char *key, char *buf, size_t size, size_t *length );
+
 
+// Multiple values per key - keyed by string
+HASHRESULT add_multi_by_str( jwHashTable*, char *key, long int value );
+HASHRESULT del_multi_by_str( jwHashTable*, char *key, long int value );
+HASHRESULT get_multi_by_str( jwHashTable *table, char *key, long int **values, size_t *count );
 
 // Add to table - keyed by int
 HASHRESULT add_str_by_int( jwHashTable*, long int key, char *value );
@@ -112,10 +294,16 @@ HASHRESULT add_ptr_by_int( jwHashTable*, long int key, void *value );
 // Delete by int
 HASHRESULT del_by_int( jwHashTable*, long int key );
 
-// Get by int
+// Get by int, get_str_by_int as get_str_by_str above
 HASHRESULT get_str_by_int( jwHashTable *table, long int key, char **value );
 HASHRESULT get_int_by_int( jwHashTable *table, long int key, int *i );
 HASHRESULT get_dbl_by_int( jwHashTable *table, long int key, double *val );
+HASHRESULT get_strbuf_by_int( jwHashTable *table, long int key, char *buf, size_t size, size_t *length );
+
+// Multiple values per key - keyed by int
+HASHRESULT add_multi_by_int( jwHashTable*, long int key, long int value );
+HASHRESULT del_multi_by_int( jwHashTable*, long int key, long int value );
+HASHRESULT get_multi_by_int( jwHashTable *table, long int key, long int **values, size_t *count );
 
 #endif
 
@@ -0,0 +1,552 @@
+/*
+
+Copyright 2015 Jonathan Watmough
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+	http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+// Concurrency stress test and linearizability checker.
+//
+// Threads run a seeded mix of add/get/del on int values, over keys that are
+// partly private to each thread and partly shared by all of them. Each call is
+// recorded with a ticket taken from one counter before it starts and another
+// after it returns, so if one call's end ticket is below another's start
+// ticket it really did finish first. Linearizability is checked per key, which
+// is enough since keys are independent (Herlihy & Wing), with the Wing & Gong
+// search and Lowe's cache of already explored states. Every add writes a value
+// no other call writes, so a get returning a value nobody wrote shows up too.
+//
+// The same run doubles as a throughput benchmark for each locking strategy:
+//
+//	table	the HASHTHREADED table as it is
+//	global	one mutex around every call, always linearizable
+//	rwlock	a reader/writer lock, gets share it
+//	shared	a create_shared_hash table, which locks each bucket on every call
+//
+// make stress, or make stress TSAN=1 to build it with ThreadSanitizer.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/time.h>
+#include "jwHash.h"
+
+typedef enum { OPADD, OPGET, OPDEL } OPKIND;
+
+// one call and what it returned
+typedef struct record
+{
+	unsigned long start;			// tickets, see above
+	unsigned long end;
+	int key;
+	OPKIND op;
+	HASHRESULT result;
+	int value;						// written by add, read by get
+} record;
+
+typedef struct options
+{
+	int threads;
+	int keys;						// shared keys, each thread also has as many private ones
+	int overlap;					// percent of calls on shared keys
+	long ops;						// calls per thread
+	int gets;						// percent of calls that are get_*
+	int dels;						// percent that are del_*, the rest are add_*
+	int strkeys;					// use add_int_by_str etc instead of the _by_int calls
+	int yield;						// percent of calls followed by sched_yield
+	int check;						// record histories and check them
+	unsigned long seed;
+	const char *strategy;			// one of the above, or all
+} options;
+
+typedef struct worker
+{
+	pthread_t thread;
+	int id;
+	options *opt;
+	jwHashTable *table;
+	record *history;
+} worker;
+
+static volatile unsigned long ticket;
+static pthread_mutex_t globallock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t rwlock = PTHREAD_RWLOCK_INITIALIZER;
+static int strategy;				// index into strategies
+static const char *strategies[] = { "table", "global", "rwlock", "shared", NULL };
+
+// xorshift64*, each thread's calls depend only on the seed and its id
+static inline unsigned long nextrand(unsigned long *state)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 2685821657736338717UL;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// RUNNING
+
+static inline void lockfor(OPKIND op)
+{
+	if(strategy==1)
+		pthread_mutex_lock(&globallock);
+	else if(strategy==2 && op==OPGET)
+		pthread_rwlock_rdlock(&rwlock);
+	else if(strategy==2)
+		pthread_rwlock_wrlock(&rwlock);
+}
+
+static inline void unlockfor(void)
+{
+	if(strategy==1)
+		pthread_mutex_unlock(&globallock);
+	else if(strategy==2)
+		pthread_rwlock_unlock(&rwlock);
+}
+
+static inline HASHRESULT call(worker *w, record *r)
+{
+	HASHRESULT result;
+	char key[16];
+	if(w->opt->strkeys)
+		sprintf(key,"k%d",r->key);
+	lockfor(r->op);
+	switch(r->op) {
+	case OPADD:
+		result = w->opt->strkeys ? add_int_by_str(w->table,key,r->value) : add_int_by_int(w->table,r->key,r->value);
+		break;
+	case OPGET:
+		result = w->opt->strkeys ? get_int_by_str(w->table,key,&r->value) : get_int_by_int(w->table,r->key,&r->value);
+		break;
+	default:
+		result = w->opt->strkeys ? del_by_str(w->table,key) : del_by_int(w->table,r->key);
+		break;
+	}
+	unlockfor();
+	return result;
+}
+
+static void *run(void *arg)
+{
+	worker *w = (worker *)arg;
+	options *opt = w->opt;
+	unsigned long state = opt->seed*2654435761UL + w->id + 1;
+	record r;
+	long i;
+	for(i=0;i<opt->ops;++i) {
+		int pick = (int)(nextrand(&state)%100);
+		r.op = pick<opt->gets ? OPGET : pick<opt->gets+opt->dels ? OPDEL : OPADD;
+		if((int)(nextrand(&state)%100)<opt->overlap)
+			r.key = (int)(nextrand(&state)%opt->keys);
+		else
+			r.key = opt->keys*(w->id+1) + (int)(nextrand(&state)%opt->keys);
+		// unique per call, see checkkey
+		r.value = r.op==OPADD ? (int)(i<<8 | w->id) : -1;
+		if(opt->check)
+			r.start = __sync_fetch_and_add(&ticket,1);
+		r.result = call(w,&r);
+		if(opt->check) {
+			r.end = __sync_fetch_and_add(&ticket,1);
+			w->history[i] = r;
+		}
+		if(opt->yield && (int)(nextrand(&state)%100)<opt->yield)
+			sched_yield();
+	}
+	return NULL;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// CHECKING
+//
+// The model of one key is a register that's either empty or holds a value:
+//
+//	add		empty -> HASHOK, or holding another value -> HASHREPLACEDVALUE
+//	get		empty -> HASHNOTFOUND, or holding v -> HASHOK with v
+//	del		empty -> HASHNOTFOUND, or holding a value -> HASHDELETED
+//
+// Calls become call and return events sorted by ticket in a linked list. The
+// search linearizes the first pending call it can, lifting its events out of
+// the list, and backtracks when it reaches a return with no call left to
+// linearize. Each (set of linearized calls, register) pair is only explored
+// once.
+
+#define EMPTY (-1)
+
+typedef struct event event;
+struct event
+{
+	unsigned long ticket;
+	int call;						// index into the key's records
+	int isreturn;
+	event *match;					// the call's return, or the return's call
+	event *prev;
+	event *next;
+};
+
+typedef struct seen seen;
+struct seen
+{
+	unsigned long hash;
+	int state;
+	unsigned long *done;
+	seen *next;
+};
+
+typedef struct checker
+{
+	record **calls;
+	int ncalls;
+	int words;						// longs in each linearized set
+	seen **cache;
+	size_t cachesize;
+	size_t cached;
+} checker;
+
+// apply a call to the register, false if its result can't happen from state
+static inline int step(record *r, int state, int *next)
+{
+	switch(r->op) {
+	case OPADD:
+		*next = r->value;
+		return r->result==(state==EMPTY ? HASHOK : HASHREPLACEDVALUE);
+	case OPGET:
+		*next = state;
+		return state==EMPTY ? r->result==HASHNOTFOUND : r->result==HASHOK && r->value==state;
+	default:
+		*next = EMPTY;
+		return r->result==(state==EMPTY ? HASHNOTFOUND : HASHDELETED);
+	}
+}
+
+static unsigned long sethash(unsigned long *done, int words, int state)
+{
+	unsigned long hash = 14695981039346656037UL ^ (unsigned int)state;
+	int i;
+	for(i=0;i<words;++i)
+		hash = (hash ^ done[i]) * 1099511628211UL;
+	return hash;
+}
+
+// remember done/state, false if it was already explored
+static int remember(checker *c, unsigned long *done, int state)
+{
+	unsigned long hash = sethash(done,c->words,state);
+	seen *s;
+	for(s=c->cache[hash%c->cachesize];s;s=s->next)
+		if(s->hash==hash && s->state==state && 0==memcmp(s->done,done,c->words*sizeof(long)))
+			return 0;
+	s = (seen *)malloc(sizeof(seen));
+	if(!s) {
+		printf("Unable to allocate checker state\n");
+		abort();
+	}
+	s->done = (unsigned long *)malloc(c->words*sizeof(long));
+	if(!s->done) {
+		printf("Unable to allocate checker state\n");
+		abort();
+	}
+	memcpy(s->done,done,c->words*sizeof(long));
+	s->hash = hash;
+	s->state = state;
+	s->next = c->cache[hash%c->cachesize];
+	c->cache[hash%c->cachesize] = s;
+	c->cached++;
+	return 1;
+}
+
+static inline void lift(event *e)
+{
+	e->prev->next = e->next;
+	if(e->next)
+		e->next->prev = e->prev;
+	e->match->prev->next = e->match->next;
+	if(e->match->next)
+		e->match->next->prev = e->match->prev;
+}
+
+static inline void unlift(event *e)
+{
+	e->match->prev->next = e->match;
+	if(e->match->next)
+		e->match->next->prev = e->match;
+	e->prev->next = e;
+	if(e->next)
+		e->next->prev = e;
+}
+
+static int eventcmp(const void *a, const void *b)
+{
+	unsigned long x = (*(event **)a)->ticket, y = (*(event **)b)->ticket;
+	return x<y ? -1 : x>y;
+}
+
+// true if the key's calls are linearizable
+static int checkkey(checker *c)
+{
+	int n = c->ncalls, i, state = EMPTY, top = 0, ok = 1;
+	event *events = (event *)calloc(2*n+1,sizeof(event));
+	event **order = (event **)malloc(2*n*sizeof(event *));
+	event **stack = (event **)malloc((n+1)*sizeof(event *));
+	int *states = (int *)malloc((n+1)*sizeof(int));
+	unsigned long *done = (unsigned long *)calloc(c->words,sizeof(long));
+	event *head = &events[2*n], *e;
+	if(!events || !order || !stack || !states || !done) {
+		printf("Unable to allocate checker\n");
+		abort();
+	}
+	for(i=0;i<n;++i) {
+		events[2*i].ticket = c->calls[i]->start;
+		events[2*i].call = i;
+		events[2*i].match = &events[2*i+1];
+		events[2*i+1].ticket = c->calls[i]->end;
+		events[2*i+1].call = i;
+		events[2*i+1].isreturn = 1;
+		events[2*i+1].match = &events[2*i];
+		order[2*i] = &events[2*i];
+		order[2*i+1] = &events[2*i+1];
+	}
+	qsort(order,2*n,sizeof(event *),eventcmp);
+	head->next = order[0];
+	order[0]->prev = head;
+	for(i=1;i<2*n;++i) {
+		order[i-1]->next = order[i];
+		order[i]->prev = order[i-1];
+	}
+
+	e = head->next;
+	while(head->next) {
+		if(!e->isreturn) {
+			int next;
+			done[e->call/64] |= 1UL<<(e->call%64);
+			if(step(c->calls[e->call],state,&next) && remember(c,done,next)) {
+				stack[top] = e;
+				states[top++] = state;
+				state = next;
+				lift(e);
+				e = head->next;
+			} else {
+				done[e->call/64] &= ~(1UL<<(e->call%64));
+				e = e->next;
+			}
+		} else {
+			// a call returned before any order could explain it, undo the last choice
+			if(!top) {
+				ok = 0;
+				break;
+			}
+			e = stack[--top];
+			state = states[top];
+			done[e->call/64] &= ~(1UL<<(e->call%64));
+			unlift(e);
+			e = e->next;
+		}
+	}
+	free(events);
+	free(order);
+	free(stack);
+	free(states);
+	free(done);
+	return ok;
+}
+
+static void clearcache(checker *c)
+{
+	size_t b;
+	for(b=0;b<c->cachesize;++b) {
+		while(c->cache[b]) {
+			seen *next = c->cache[b]->next;
+			free(c->cache[b]->done);
+			free(c->cache[b]);
+			c->cache[b] = next;
+		}
+	}
+	c->cached = 0;
+}
+
+static void printcall(record *r)
+{
+	static const char *names[] = { "add", "get", "del" };
+	printf("\t[%lu,%lu] %s(%d)",r->start,r->end,names[r->op],r->key);
+	if(r->op==OPADD)
+		printf(" %d",r->value);
+	printf(" -> %d",r->result);
+	if(r->op==OPGET && r->result==HASHOK)
+		printf(" %d",r->value);
+	printf("\n");
+}
+
+static int reccmp(const void *a, const void *b)
+{
+	const record *x = *(record **)a, *y = *(record **)b;
+	if(x->key!=y->key)
+		return x->key<y->key ? -1 : 1;
+	return x->start<y->start ? -1 : x->start>y->start;
+}
+
+// check every key's history, returns the number of keys that failed
+static int checkall(worker *workers, options *opt)
+{
+	long total = opt->threads*opt->ops, i, first;
+	record **all = (record **)malloc(total*sizeof(record *));
+	checker c;
+	int t, bad = 0;
+	if(!all) {
+		printf("Unable to allocate checker\n");
+		abort();
+	}
+	for(t=0,i=0;t<opt->threads;++t) {
+		long j;
+		for(j=0;j<opt->ops;++j)
+			all[i++] = &workers[t].history[j];
+	}
+	qsort(all,total,sizeof(record *),reccmp);
+	c.cachesize = 1<<16;
+	c.cache = (seen **)calloc(c.cachesize,sizeof(seen *));
+	c.cached = 0;
+	if(!c.cache) {
+		printf("Unable to allocate checker\n");
+		abort();
+	}
+	for(first=0;first<total;first=i) {
+		for(i=first;i<total && all[i]->key==all[first]->key;++i)
+			;
+		c.calls = all+first;
+		c.ncalls = (int)(i-first);
+		c.words = (c.ncalls+63)/64;
+		if(!checkkey(&c)) {
+			if(!bad++) {
+				long j;
+				printf("key %d is not linearizable, its %d calls:\n",all[first]->key,c.ncalls);
+				for(j=first;j<i && j<first+20;++j)
+					printcall(all[j]);
+				if(i-first>20)
+					printf("\t...\n");
+			}
+		}
+		clearcache(&c);
+	}
+	free(c.cache);
+	free(all);
+	return bad;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// MAIN
+
+static int runone(options *opt)
+{
+	worker *workers = (worker *)calloc(opt->threads,sizeof(worker));
+	size_t buckets = (size_t)opt->keys*(opt->threads+1);
+	struct timeval tval_before, tval_done, tval_run;
+	jwHashTable *table;
+	double seconds;
+	int t, bad = 0;
+	if(!workers) {
+		printf("Unable to allocate workers\n");
+		abort();
+	}
+	if(strategy==3)
+		table = create_shared_hash(NULL,buckets,buckets*64+(64UL<<20));
+	else
+		table = create_hash(buckets);
+	if(!table) {
+		printf("Unable to create table\n");
+		return 1;
+	}
+	ticket = 0;
+	for(t=0;t<opt->threads;++t) {
+		workers[t].id = t;
+		workers[t].opt = opt;
+		workers[t].table = table;
+		if(opt->check) {
+			workers[t].history = (record *)malloc(opt->ops*sizeof(record));
+			if(!workers[t].history) {
+				printf("Unable to allocate history\n");
+				abort();
+			}
+		}
+	}
+	gettimeofday(&tval_before, NULL);
+	for(t=0;t<opt->threads;++t)
+		pthread_create(&workers[t].thread,NULL,run,&workers[t]);
+	for(t=0;t<opt->threads;++t)
+		pthread_join(workers[t].thread,NULL);
+	gettimeofday(&tval_done, NULL);
+	timersub(&tval_done, &tval_before, &tval_run);
+	seconds = tval_run.tv_sec + tval_run.tv_usec/1e6;
+
+	if(opt->check)
+		bad = checkall(workers,opt);
+	printf("%-8s %2d threads %7d keys %3d%% shared: %10.0f ops/sec",
+		strategies[strategy],opt->threads,opt->keys,opt->overlap,opt->threads*opt->ops/seconds);
+	if(opt->check)
+		printf(", %d keys not linearizable",bad);
+	printf("\n");
+
+	for(t=0;t<opt->threads;++t)
+		free(workers[t].history);
+	free(workers);
+	delete_hash(table);
+	return bad ? 1 : 0;
+}
+
+static void usage(const char *name)
+{
+	printf("usage: %s [options]\n"
+		"  -s strategy   table, global, rwlock, shared or all (all)\n"
+		"  -t threads    threads (4)\n"
+		"  -k keys       shared keys, and private keys per thread (1000)\n"
+		"  -o percent    calls on shared keys (50)\n"
+		"  -n ops        calls per thread (100000)\n"
+		"  -g percent    gets (50)\n"
+		"  -d percent    dels (20), the rest are adds\n"
+		"  -y percent    calls followed by sched_yield (0)\n"
+		"  -x            string keys, add_int_by_str etc\n"
+		"  -b            benchmark only, don't record or check\n"
+		"  -r seed       seed for the calls (1)\n",name);
+}
+
+int main(int argc, char *argv[])
+{
+	options opt = { 4, 1000, 50, 100000, 50, 20, 0, 0, 1, 1, "all" };
+	int c, failed = 0;
+	while((c = getopt(argc,argv,"s:t:k:o:n:g:d:y:xbr:h"))!=-1) {
+		switch(c) {
+		case 's': opt.strategy = optarg; break;
+		case 't': opt.threads = atoi(optarg); break;
+		case 'k': opt.keys = atoi(optarg); break;
+		case 'o': opt.overlap = atoi(optarg); break;
+		case 'n': opt.ops = atol(optarg); break;
+		case 'g': opt.gets = atoi(optarg); break;
+		case 'd': opt.dels = atoi(optarg); break;
+		case 'y': opt.yield = atoi(optarg); break;
+		case 'x': opt.strkeys = 1; break;
+		case 'b': opt.check = 0; break;
+		case 'r': opt.seed = strtoul(optarg,NULL,10); break;
+		default: usage(argv[0]); return 2;
+		}
+	}
+	// values pack the call number above an 8 bit thread id
+	if(opt.threads<1 || opt.threads>256 || opt.keys<1 || opt.ops<1 || opt.ops>=1L<<23) {
+		usage(argv[0]);
+		return 2;
+	}
+	for(strategy=0;strategies[strategy];++strategy)
+		if(0==strcmp(opt.strategy,"all") || 0==strcmp(opt.strategy,strategies[strategy]))
+			failed |= runone(&opt);
+	return failed;
+}
@@ -26,6 +26,11 @@ limitations under the License.
 #include <semaphore.h>
 #endif
 
+#ifdef __linux__
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 #ifdef _WIN32
 static inline void timersub(
 	const struct timeval *t1,
@@ -44,6 +49,15 @@ static inline void timersub(
 
 int basic_test();
 int thread_test();
+int build_test();
+int frozen_test();
+int filter_test();
+int stream_test();
+int mem_test();
+int multi_test();
+int compress_test();
+int index_test();
+int shared_test();
 
 int main(int argc, char *argv[])
 {
@@ -54,6 +68,35 @@ int main(int argc, char *argv[])
 	if( 0==thread_test() ) {
 		printf("thread_test:\tPassed\n");
 	}
+	if( 0==build_test() ) {
+		printf("build_test:\tPassed\n");
+	}
+	if( 0==frozen_test() ) {
+		printf("frozen_test:\tPassed\n");
+	}
+	if( 0==filter_test() ) {
+		printf("filter_test:\tPassed\n");
+	}
+	if( 0==stream_test() ) {
+		printf("stream_test:\tPassed\n");
+	}
+	if( 0==mem_test() ) {
+		printf("mem_test:\tPassed\n");
+	}
+	if( 0==multi_test() ) {
+		printf("multi_test:\tPassed\n");
+	}
+	if( 0==compress_test() ) {
+		printf("compress_test:\tPassed\n");
+	}
+	if( 0==index_test() ) {
+		printf("index_test:\tPassed\n");
+	}
+#ifdef __linux__
+	if( 0==shared_test() ) {
+		printf("shared_test:\tPassed\n");
+	}
+#endif
 #endif
 	return 0;
 }
@@ -116,6 +159,7 @@ int basic_test()
 
 #define NUMTHREADS 6
 #define HASHCOUNT 1000000
+#define BUILDBIGCOUNT 10000000
 
 typedef struct threadinfo {jwHashTable *table; int start;} threadinfo;
 void * thread_func(void *arg)
@@ -178,5 +222,1012 @@ int thread_test()
 	return 0;
 }
 
+int build_test()
+{
+	// duplicates resolve like repeated add_*, last value wins
+	jwHashPair dups[3] = {
+		{ .key.strValue="a", .valtag=HASHNUMERIC, .value.intValue=1 },
+		{ .key.strValue="b", .valtag=HASHSTRING, .value.strValue="two" },
+		{ .key.strValue="a", .valtag=HASHNUMERIC, .value.intValue=3 },
+	};
+	jwHashTable * table = build_hash_from_array(dups,3,HASHKEYSTR,0);
+	int j;
+	char * str;
+	if(!table)
+		return 1;
+	if(HASHOK!=get_int_by_str(table,"a",&j) || j!=3) {
+		printf("Error: duplicate a -> %d\n",j);
+		return 1;
+	}
+	if(HASHOK!=get_str_by_str(table,"b",&str) || strcmp(str,"two")) {
+		printf("Error: b not found\n");
+		return 1;
+	}
+	// entries from the build can be deleted and reused
+	del_by_str(table,"b");
+	add_int_by_str(table,"c",4);
+	if(HASHNOTFOUND!=get_str_by_str(table,"b",&str) || HASHOK!=get_int_by_str(table,"c",&j) || j!=4) {
+		printf("Error: delete/add after build\n");
+		return 1;
+	}
+	delete_hash(table);
+
+	// build a million ints by string, compare with the threaded add_int_by_str loop
+	struct timeval tval_before, tval_done1, tval_done2, tval_build, tval_unique;
+	jwHashPair * pairs = (jwHashPair *)malloc(HASHCOUNT*sizeof(jwHashPair));
+	char * keys = (char *)malloc(HASHCOUNT*12);
+	int i;
+	for(i=0;i<HASHCOUNT;++i) {
+		sprintf(keys+i*12,"%d",i);
+		pairs[i].key.strValue = keys+i*12;
+		pairs[i].valtag = HASHNUMERIC;
+		pairs[i].value.intValue = i;
+	}
+	gettimeofday(&tval_before, NULL);
+	table = build_hash_from_array(pairs,HASHCOUNT,HASHKEYSTR,0);
+	gettimeofday(&tval_done1, NULL);
+	delete_hash(table);
+	gettimeofday(&tval_done2, NULL);
+	table = build_hash_from_array(pairs,HASHCOUNT,HASHKEYSTR,HASHBUILDUNIQUE);
+	timersub(&tval_done1, &tval_before, &tval_build);
+	gettimeofday(&tval_done1, NULL);
+	timersub(&tval_done1, &tval_done2, &tval_unique);
+
+	int error = 0;
+	for(i=0;i<HASHCOUNT;++i) {
+		if(HASHOK!=get_int_by_str(table,keys+i*12,&j) || i!=j) {
+			printf("Error: %d != %d\n",i,j);
+			error = 1;
+		}
+	}
+	if(!error) {
+		printf("No errors.\n");
+	}
+	printf("Build %d ints by string: %ld.%06ld sec, unique keys: %ld.%06ld sec\n",HASHCOUNT,
+		(long int)tval_build.tv_sec, (long int)tval_build.tv_usec,
+		(long int)tval_unique.tv_sec, (long int)tval_unique.tv_usec);
+	delete_hash(table);
+	free(pairs);
+	free(keys);
+	if(error)
+		return error;
+
+	// ten million keys, build against an add_int_by_str loop
+	struct timeval tval_add;
+	pairs = (jwHashPair *)malloc(BUILDBIGCOUNT*sizeof(jwHashPair));
+	keys = (char *)malloc(BUILDBIGCOUNT*12);
+	for(i=0;i<BUILDBIGCOUNT;++i) {
+		sprintf(keys+i*12,"%d",i);
+		pairs[i].key.strValue = keys+i*12;
+		pairs[i].valtag = HASHNUMERIC;
+		pairs[i].value.intValue = i;
+	}
+	gettimeofday(&tval_before, NULL);
+	table = create_hash(BUILDBIGCOUNT);
+	for(i=0;i<BUILDBIGCOUNT;++i)
+		add_int_by_str(table,keys+i*12,i);
+	gettimeofday(&tval_done1, NULL);
+	timersub(&tval_done1, &tval_before, &tval_add);
+	delete_hash(table);
+	gettimeofday(&tval_before, NULL);
+	table = build_hash_from_array(pairs,BUILDBIGCOUNT,HASHKEYSTR,HASHBUILDUNIQUE);
+	gettimeofday(&tval_done1, NULL);
+	timersub(&tval_done1, &tval_before, &tval_build);
+	for(i=0;i<BUILDBIGCOUNT && !error;i+=997)
+		error = HASHOK!=get_int_by_str(table,keys+i*12,&j) || i!=j;
+	printf("%d ints by string: add loop %ld.%06ld sec, build %ld.%06ld sec, %.1fx\n",BUILDBIGCOUNT,
+		(long int)tval_add.tv_sec, (long int)tval_add.tv_usec,
+		(long int)tval_build.tv_sec, (long int)tval_build.tv_usec,
+		(tval_add.tv_sec+tval_add.tv_usec/1e6)/(tval_build.tv_sec+tval_build.tv_usec/1e6));
+	delete_hash(table);
+	free(pairs);
+	free(keys);
+	return error;
+}
+
+// load a copy of a saved table with size bytes at offset at (from the end if
+// negative) replaced, cut to length bytes if length isn't 0
+static jwHashTable * frozen_corrupt(const char * path, long at, const void * bytes, size_t size, long length)
+{
+	FILE * file = fopen(path,"rb");
+	jwHashTable * table;
+	char * data;
+	long n;
+	if(!file)
+		return NULL;
+	fseek(file,0,SEEK_END);
+	n = ftell(file);
+	fseek(file,0,SEEK_SET);
+	data = (char *)malloc(n);
+	if(1!=fread(data,n,1,file)) {
+		fclose(file);
+		free(data);
+		return NULL;
+	}
+	fclose(file);
+	memcpy(data+(at<0 ? n+at : at),bytes,size);
+	file = fopen("frozen_bad.bin","wb");
+	fwrite(data,length ? length : n,1,file);
+	fclose(file);
+	free(data);
+	table = load_frozen_hash("frozen_bad.bin");
+	remove("frozen_bad.bin");
+	return table;
+}
+
+int frozen_test()
+{
+	// mixed keys and values survive freezing
+	jwHashTable * table = create_hash(10);
+	char * str;
+	double d;
+	int i,j;
+	add_str_by_str(table,"oldest","Jonathan");
+	add_dbl_by_str(table,"pi",3.25);
+	add_int_by_int(table,42,7);
+	add_str_by_int(table,-1,"minus one");
+	if(HASHOK!=freeze_hash(table) || HASHFROZEN!=add_int_by_int(table,1,1) || HASHFROZEN!=del_by_str(table,"pi"))
+		return 1;
+	if(HASHOK!=get_str_by_str(table,"oldest",&str) || strcmp(str,"Jonathan") ||
+	   HASHOK!=get_dbl_by_str(table,"pi",&d) || d!=3.25 ||
+	   HASHOK!=get_int_by_int(table,42,&j) || j!=7 ||
+	   HASHOK!=get_str_by_int(table,-1,&str) || strcmp(str,"minus one") ||
+	   HASHNOTFOUND!=get_str_by_str(table,"youngest",&str) || HASHNOTFOUND!=get_int_by_int(table,43,&j)) {
+		printf("Error: frozen lookup\n");
+		return 1;
+	}
+	if(HASHOK!=save_frozen_hash(table,"frozen_test.bin"))
+		return 1;
+	delete_hash(table);
+	// truncated, no groups for the keys, a count that overflows, a string block without its terminator
+	unsigned long long zero = 0, huge = 1ULL<<62;
+	char last = 'x';
+	if(frozen_corrupt("frozen_test.bin",0,"",0,100) || frozen_corrupt("frozen_test.bin",16,&zero,sizeof(zero),0) ||
+	   frozen_corrupt("frozen_test.bin",8,&huge,sizeof(huge),0) || frozen_corrupt("frozen_test.bin",-1,&last,1,0)) {
+		printf("Error: loaded a corrupt frozen table\n");
+		return 1;
+	}
+	table = load_frozen_hash("frozen_test.bin");
+	remove("frozen_test.bin");
+	if(!table || HASHOK!=get_str_by_int(table,-1,&str) || strcmp(str,"minus one") ||
+	   HASHOK!=get_dbl_by_str(table,"pi",&d) || d!=3.25) {
+		printf("Error: loaded frozen lookup\n");
+		return 1;
+	}
+	delete_hash(table);
+
+	// a million ints by string, chained then frozen
+	struct timeval tval_before, tval_done1, tval_done2, tval_done3, tval_chained, tval_freeze, tval_frozen;
+	char buffer[512];
+	int error = 0;
+	table = create_hash(HASHCOUNT>>2);
+	for(i=0;i<HASHCOUNT;++i) {
+		sprintf(buffer,"%d",i);
+		add_int_by_str(table,buffer,i);
+	}
+	// read in a scattered order so neither form gets sequential buckets for free
+	gettimeofday(&tval_before, NULL);
+	for(i=0;i<HASHCOUNT;++i) {
+		sprintf(buffer,"%d",(int)(i*2654435761u%HASHCOUNT));
+		get_int_by_str(table,buffer,&j);
+	}
+	gettimeofday(&tval_done1, NULL);
+	freeze_hash(table);
+	gettimeofday(&tval_done2, NULL);
+	for(i=0;i<HASHCOUNT;++i) {
+		int k = (int)(i*2654435761u%HASHCOUNT);
+		sprintf(buffer,"%d",k);
+		if(HASHOK!=get_int_by_str(table,buffer,&j) || k!=j) {
+			printf("Error: %d != %d\n",k,j);
+			error = 1;
+		}
+	}
+	gettimeofday(&tval_done3, NULL);
+	if(!error) {
+		printf("No errors.\n");
+	}
+	timersub(&tval_done1, &tval_before, &tval_chained);
+	timersub(&tval_done2, &tval_done1, &tval_freeze);
+	timersub(&tval_done3, &tval_done2, &tval_frozen);
+	printf("Read %d ints chained: %ld.%06ld sec, freeze: %ld.%06ld sec, read frozen: %ld.%06ld sec\n",HASHCOUNT,
+		(long int)tval_chained.tv_sec, (long int)tval_chained.tv_usec,
+		(long int)tval_freeze.tv_sec, (long int)tval_freeze.tv_usec,
+		(long int)tval_frozen.tv_sec, (long int)tval_frozen.tv_usec);
+	delete_hash(table);
+	return error;
+}
+
+int filter_test()
+{
+	// a million ints by string, then look up a million keys that aren't there
+	struct timeval tval_before, tval_done1, tval_done2, tval_done3, tval_plain, tval_filtered;
+	jwHashFilterStats stats;
+	char buffer[512];
+	int i,j;
+	int error = 0;
+	jwHashTable * table = create_hash(HASHCOUNT>>2);
+	for(i=0;i<HASHCOUNT;++i) {
+		sprintf(buffer,"%d",i);
+		add_int_by_str(table,buffer,i);
+	}
+	gettimeofday(&tval_before, NULL);
+	for(i=0;i<HASHCOUNT;++i) {
+		sprintf(buffer,"x%d",i);
+		if(HASHNOTFOUND!=get_int_by_str(table,buffer,&j))
+			error = 1;
+	}
+	gettimeofday(&tval_done1, NULL);
+	enable_filter(table,HASHCOUNT,10);
+	gettimeofday(&tval_done2, NULL);
+	for(i=0;i<HASHCOUNT;++i) {
+		sprintf(buffer,"x%d",i);
+		if(HASHNOTFOUND!=get_int_by_str(table,buffer,&j))
+			error = 1;
+	}
+	gettimeofday(&tval_done3, NULL);
+	timersub(&tval_done1, &tval_before, &tval_plain);
+	timersub(&tval_done3, &tval_done2, &tval_filtered);
+	// and again counting, which the timing above leaves out, half through get_strbuf_by_str
+	char value[32];
+	size_t length;
+	get_filter_stats(table,&stats);
+	if(stats.lookups!=0)
+		error = 1;
+	enable_filter_stats(table);
+	for(i=0;i<HASHCOUNT;++i) {
+		sprintf(buffer,"x%d",i);
+		if(i&1)
+			get_strbuf_by_str(table,buffer,value,sizeof(value),&length);
+		else
+			get_int_by_str(table,buffer,&j);
+	}
+	get_filter_stats(table,&stats);
+	printf("Miss %d ints by string: %ld.%06ld sec, with filter: %ld.%06ld sec, %lu bytes, false positive rate %.4f, %.0f ns per miss\n",HASHCOUNT,
+		(long int)tval_plain.tv_sec, (long int)tval_plain.tv_usec,
+		(long int)tval_filtered.tv_sec, (long int)tval_filtered.tv_usec,
+		(unsigned long)stats.bytes, stats.fprate, stats.missns);
+	if(stats.lookups!=HASHCOUNT || stats.rejected+stats.falsepositives!=HASHCOUNT || stats.missns<=0)
+		error = 1;
+
+	// keys added and deleted with the filter on are still handled
+	add_int_by_str(table,"new",1);
+	del_by_str(table,"0");
+	for(i=1;i<HASHCOUNT;++i) {
+		sprintf(buffer,"%d",i);
+		if(HASHOK!=get_int_by_str(table,buffer,&j) || i!=j) {
+			printf("Error: %d != %d\n",i,j);
+			error = 1;
+		}
+	}
+	get_filter_stats(table,&stats);
+	if(HASHOK!=get_int_by_str(table,"new",&j) || HASHNOTFOUND!=get_int_by_str(table,"0",&j) || stats.stale!=1)
+		error = 1;
+	if(!error) {
+		printf("No errors.\n");
+	}
+	delete_hash(table);
+	return error;
+}
+
+#define STREAMCOUNT (HASHCOUNT*4)
+#define STREAMWIDTH 16
+
+int stream_test()
+{
+	// frozen tables and misses come through a stream too
+	jwHashTable * table = create_hash(10);
+	jwHashStream * stream;
+	jwHashStreamResult result;
+	int found = 0, missed = 0;
+	add_int_by_int(table,1,10);
+	add_int_by_int(table,2,20);
+	add_multi_by_int(table,4,40);
+	add_multi_by_int(table,4,41);
+	freeze_hash(table);
+	stream = create_stream(table,2);
+	stream_feed_int(stream,1,(void *)1);
+	stream_feed_int(stream,3,(void *)3);
+	if(stream_feed_int(stream,2,(void *)2))
+		return 1;
+	while(stream_next(stream,&result)) {
+		if(result.result==HASHOK && result.tag==(void *)1 && result.value.intValue==10)
+			found++;
+		if(result.result==HASHNOTFOUND && result.tag==(void *)3)
+			missed++;
+	}
+	if(!stream_feed_int(stream,4,(void *)4) || !stream_next(stream,&result) || result.result!=HASHMULTIPLE)
+		return 1;
+	delete_stream(stream);
+	delete_hash(table);
+	if(found!=1 || missed!=1)
+		return 1;
+
+	// compressed values aren't handed out as they are
+	char value[64];
+	memset(value,'z',sizeof(value)-1);
+	value[sizeof(value)-1] = 0;
+	table = create_hash(10);
+	enable_compression(table,NULL,0);
+	add_str_by_str(table,"long",value);
+	stream = create_stream(table,2);
+	if(!stream_feed_str(stream,"long",NULL) || !stream_next(stream,&result) || result.result!=HASHCOMPRESSED)
+		return 1;
+	delete_stream(stream);
+	delete_hash(table);
+
+	// four million ints by string, well past the last level cache, read in scattered order
+	struct timeval tval_before, tval_done1, tval_done2, tval_scalar, tval_stream;
+	char * keys = (char *)malloc(STREAMCOUNT*12);
+	int i,j;
+	int error = 0;
+	table = create_hash(STREAMCOUNT>>2);
+	for(i=0;i<STREAMCOUNT;++i) {
+		sprintf(keys+i*12,"%d",i);
+		add_int_by_str(table,keys+i*12,i);
+	}
+	gettimeofday(&tval_before, NULL);
+	for(i=0;i<STREAMCOUNT;++i) {
+		int k = (int)(i*2654435761u%STREAMCOUNT);
+		if(HASHOK!=get_int_by_str(table,keys+k*12,&j) || k!=j)
+			error = 1;
+	}
+	gettimeofday(&tval_done1, NULL);
+	stream = create_stream(table,STREAMWIDTH);
+	for(i=0;i<STREAMCOUNT;++i) {
+		long int k = (long int)(i*2654435761u%STREAMCOUNT);
+		while(!stream_feed_str(stream,keys+k*12,(void *)k)) {
+			stream_next(stream,&result);
+			if(result.result!=HASHOK || result.value.intValue!=(long int)result.tag)
+				error = 1;
+		}
+	}
+	while(stream_next(stream,&result)) {
+		if(result.result!=HASHOK || result.value.intValue!=(long int)result.tag)
+			error = 1;
+	}
+	gettimeofday(&tval_done2, NULL);
+	if(!error) {
+		printf("No errors.\n");
+	}
+	timersub(&tval_done1, &tval_before, &tval_scalar);
+	timersub(&tval_done2, &tval_done1, &tval_stream);
+	printf("Read %d ints by string: %ld.%06ld sec, streamed %d wide: %ld.%06ld sec\n",STREAMCOUNT,
+		(long int)tval_scalar.tv_sec, (long int)tval_scalar.tv_usec,STREAMWIDTH,
+		(long int)tval_stream.tv_sec, (long int)tval_stream.tv_usec);
+	delete_stream(stream);
+	delete_hash(table);
+	free(keys);
+	return error;
+}
+
+// time scattered reads of four million ints by int, random enough to miss the TLB on 4 KiB pages
+static int mem_read(jwHashTable * table, struct timeval * tval_read)
+{
+	struct timeval tval_before, tval_done;
+	int i,j;
+	int error = 0;
+	for(i=0;i<STREAMCOUNT;++i)
+		add_int_by_int(table,i,i);
+	del_by_int(table,0);
+	add_int_by_int(table,0,0);
+	gettimeofday(&tval_before, NULL);
+	for(i=0;i<STREAMCOUNT;++i) {
+		int k = (int)(i*2654435761u%STREAMCOUNT);
+		if(HASHOK!=get_int_by_int(table,k,&j) || k!=j)
+			error = 1;
+	}
+	gettimeofday(&tval_done, NULL);
+	timersub(&tval_done, &tval_before, tval_read);
+	delete_hash(table);
+	return error;
+}
+
+int mem_test()
+{
+	struct timeval tval_plain, tval_huge, tval_interleave;
+	jwHashTable * table = create_hash_mem(10,HASHMEMHUGE|HASHMEMINTERLEAVE,0);
+	// placement that fell back is reported, out of range nodes are refused
+	printf("Huge pages interleaved%s%s\n",table->memmissed & HASHMEMHUGE ? ", no huge pages" : "",
+		table->memmissed & HASHMEMINTERLEAVE ? ", not interleaved" : "");
+	delete_hash(table);
+	if(create_hash_mem(10,HASHMEMBIND,HASHMAXNODES) || create_hash_mem(10,HASHMEMBIND,-1))
+		return 1;
+	int error = mem_read(create_hash(STREAMCOUNT),&tval_plain);
+	error |= mem_read(create_hash_mem(STREAMCOUNT,HASHMEMHUGE,0),&tval_huge);
+	error |= mem_read(create_hash_mem(STREAMCOUNT,HASHMEMHUGE|HASHMEMINTERLEAVE,0),&tval_interleave);
+	if(!error) {
+		printf("No errors.\n");
+	}
+	printf("Read %d ints by int: %ld.%06ld sec, huge pages: %ld.%06ld sec, huge pages interleaved: %ld.%06ld sec\n",STREAMCOUNT,
+		(long int)tval_plain.tv_sec, (long int)tval_plain.tv_usec,
+		(long int)tval_huge.tv_sec, (long int)tval_huge.tv_usec,
+		(long int)tval_interleave.tv_sec, (long int)tval_interleave.tv_usec);
+	return error;
+}
+
+#define MULTIKEYS HASHCOUNT
+#define MULTIVALUES 10
+
+// the old way, a heap list per key behind add_ptr_by_str
+typedef struct rowlist {size_t count; size_t capacity; long int *values;} rowlist;
+
+#define MULTITHREADS 4
+#define MULTIAPPENDS 10000
+
+// threads appending to the same few keys
+static void * multi_func(void *arg)
+{
+	jwHashTable *table = arg;
+	int i;
+	for(i=0;i<MULTIAPPENDS;++i)
+		add_multi_by_int(table,i%100,i);
+	return NULL;
+}
+
+int multi_test()
+{
+	// append, remove one, remove the last, and freeze
+	jwHashTable * table = create_hash(10);
+	long int * values;
+	size_t count;
+	add_multi_by_str(table,"red",1);
+	add_multi_by_str(table,"red",2);
+	add_multi_by_str(table,"red",3);
+	add_multi_by_int(table,7,70);
+	if(HASHDELETED!=del_multi_by_str(table,"red",2) || HASHNOTFOUND!=del_multi_by_str(table,"red",2))
+		return 1;
+	if(HASHOK!=get_multi_by_str(table,"red",&values,&count) || count!=2 || values[0]!=1 || values[1]!=3)
+		return 1;
+	// single and multi valued keys don't mix
+	char *str;
+	int v;
+	add_int_by_str(table,"blue",5);
+	if(HASHALREADYADDED!=add_str_by_str(table,"red","x") || HASHALREADYADDED!=add_int_by_str(table,"red",1) ||
+	   HASHNOTFOUND!=get_int_by_str(table,"red",&v) || HASHNOTFOUND!=get_str_by_str(table,"red",&str) ||
+	   HASHALREADYADDED!=add_multi_by_str(table,"blue",1) || HASHOK!=get_int_by_str(table,"blue",&v) || v!=5)
+		return 1;
+	del_by_str(table,"blue");
+	del_multi_by_int(table,7,70);
+	if(HASHNOTFOUND!=get_multi_by_int(table,7,&values,&count))
+		return 1;
+	add_multi_by_int(table,8,80);
+	freeze_hash(table);
+	save_frozen_hash(table,"multi_test.bin");
+	delete_hash(table);
+	// the value block holds two runs, red's 2,1,3 and 8's 1,80; negative counts must not load
+	long int negative[5] = { -1, -1, -1, -1, -1 };
+	if(frozen_corrupt("multi_test.bin",-(long)sizeof(negative),negative,sizeof(negative),0))
+		return 1;
+	table = load_frozen_hash("multi_test.bin");
+	remove("multi_test.bin");
+	if(!table || HASHOK!=get_multi_by_str(table,"red",&values,&count) || count!=2 || values[1]!=3 ||
+	   HASHOK!=get_multi_by_int(table,8,&values,&count) || count!=1 || values[0]!=80 ||
+	   HASHNOTFOUND!=get_int_by_str(table,"red",&v))
+		return 1;
+	delete_hash(table);
+
+	// appends from several threads are all kept
+	pthread_t threads[MULTITHREADS];
+	int t;
+	table = create_hash(16);
+	for(t=0;t<MULTITHREADS;++t)
+		pthread_create(&threads[t],NULL,multi_func,table);
+	for(t=0;t<MULTITHREADS;++t)
+		pthread_join(threads[t],NULL);
+	for(t=0;t<100;++t)
+		if(HASHOK!=get_multi_by_int(table,t,&values,&count) || count!=MULTITHREADS*MULTIAPPENDS/100)
+			return 1;
+	delete_hash(table);
+
+	// a million keys with ten row ids each, build then scan every key's rows in scattered order
+	struct timeval tval_before, tval_done1, tval_done2, tval_done3, tval_done4;
+	struct timeval tval_listadd, tval_listscan, tval_multiadd, tval_multiscan;
+	jwHashTable * lists = create_hash(MULTIKEYS);
+	char * keys = (char *)malloc(MULTIKEYS*12);
+	long int sum1 = 0, sum2 = 0;
+	int i,j,k;
+	table = create_hash(MULTIKEYS);
+	for(i=0;i<MULTIKEYS;++i)
+		sprintf(keys+i*12,"%d",i);
+	gettimeofday(&tval_before, NULL);
+	for(j=0;j<MULTIVALUES;++j) {
+		for(i=0;i<MULTIKEYS;++i) {
+			rowlist * list;
+			if(HASHOK!=get_ptr_by_str(lists,keys+i*12,(void **)&list)) {
+				list = (rowlist *)calloc(1,sizeof(rowlist));
+				add_ptr_by_str(lists,keys+i*12,list);
+			}
+			if(list->count==list->capacity) {
+				list->capacity = list->capacity ? list->capacity*2 : 4;
+				list->values = (long int *)realloc(list->values,list->capacity*sizeof(long int));
+			}
+			list->values[list->count++] = i*MULTIVALUES+j;
+		}
+	}
+	gettimeofday(&tval_done1, NULL);
+	for(i=0;i<MULTIKEYS;++i) {
+		rowlist * list;
+		k = (int)(i*2654435761u%MULTIKEYS);
+		get_ptr_by_str(lists,keys+k*12,(void **)&list);
+		for(j=0;j<(int)list->count;++j)
+			sum1 += list->values[j];
+	}
+	gettimeofday(&tval_done2, NULL);
+	for(j=0;j<MULTIVALUES;++j) {
+		for(i=0;i<MULTIKEYS;++i)
+			add_multi_by_str(table,keys+i*12,i*MULTIVALUES+j);
+	}
+	gettimeofday(&tval_done3, NULL);
+	for(i=0;i<MULTIKEYS;++i) {
+		k = (int)(i*2654435761u%MULTIKEYS);
+		get_multi_by_str(table,keys+k*12,&values,&count);
+		for(j=0;j<(int)count;++j)
+			sum2 += values[j];
+	}
+	gettimeofday(&tval_done4, NULL);
+	timersub(&tval_done1, &tval_before, &tval_listadd);
+	timersub(&tval_done2, &tval_done1, &tval_listscan);
+	timersub(&tval_done3, &tval_done2, &tval_multiadd);
+	timersub(&tval_done4, &tval_done3, &tval_multiscan);
+	if(sum1!=sum2) {
+		printf("Error: %ld != %ld\n",sum1,sum2);
+		return 1;
+	}
+	printf("No errors.\n");
+	printf("%d keys x %d rows, lists by ptr: add %ld.%06ld sec, scan %ld.%06ld sec; multi: add %ld.%06ld sec, scan %ld.%06ld sec\n",
+		MULTIKEYS,MULTIVALUES,
+		(long int)tval_listadd.tv_sec, (long int)tval_listadd.tv_usec,
+		(long int)tval_listscan.tv_sec, (long int)tval_listscan.tv_usec,
+		(long int)tval_multiadd.tv_sec, (long int)tval_multiadd.tv_usec,
+		(long int)tval_multiscan.tv_sec, (long int)tval_multiscan.tv_usec);
+	for(i=0;i<MULTIKEYS;++i) {
+		rowlist * list;
+		get_ptr_by_str(lists,keys+i*12,(void **)&list);
+		free(list->values);
+		free(list);
+	}
+	free(keys);
+	delete_hash(lists);
+	delete_hash(table);
+	return 0;
+}
+
+#define COMPRESSCOUNT (HASHCOUNT/4)
+
+// a json-ish record, the kind of value that repeats most of itself
+static void make_record(char *buf, int i)
+{
+	sprintf(buf,"{\"id\":%d,\"name\":\"customer-%d\",\"status\":\"%s\",\"country\":\"%s\","
+		"\"created\":\"2015-%02d-%02dT10:%02d:00Z\",\"tags\":[\"retail\",\"newsletter\"],"
+		"\"address\":{\"street\":\"%d Main Street\",\"city\":\"Springfield\",\"zip\":\"%05d\"}}",
+		i,i,i%3 ? "active" : "suspended",i%2 ? "US" : "CA",i%12+1,i%28+1,i%60,i%997,i%100000);
+}
+
+int compress_test()
+{
+	// short values stay plain, long ones are decoded for get_str_* or into the caller's buffer
+	static const char dict[] = "{\"id\":,\"name\":\"customer-\",\"status\":\"active\",\"country\":\"US\","
+		"\"created\":\"2015-T10::00Z\",\"tags\":[\"retail\",\"newsletter\"],"
+		"\"address\":{\"street\":\" Main Street\",\"city\":\"Springfield\",\"zip\":\"\"}}";
+	jwHashTable * table = create_hash(10);
+	jwHashCompressStats stats;
+	char record[512], buf[512];
+	char * str;
+	size_t length;
+	enable_compression(table,(char *)dict,sizeof(dict)-1);
+	make_record(record,42);
+	add_str_by_str(table,"short","hello");
+	add_str_by_int(table,42,record);
+	if(HASHOK!=get_str_by_str(table,"short",&str) || strcmp(str,"hello"))
+		return 1;
+	if(HASHOK!=get_str_by_int(table,42,&str) || strcmp(str,record))
+		return 1;
+	// two compressed values read by one thread both stay valid, and a second read reuses the copy
+	char record2[512];
+	char * str2, * again;
+	make_record(record2,43);
+	add_str_by_int(table,43,record2);
+	if(HASHOK!=get_str_by_int(table,43,&str2) || HASHOK!=get_str_by_int(table,42,&again) || again!=str ||
+	   strcmp(str,record) || strcmp(str2,record2))
+		return 1;
+	get_compression_stats(table,&stats);
+	if(stats.decodedbytes!=strlen(record)+strlen(record2)+2)
+		return 1;
+	del_by_int(table,43);
+	if(HASHOK!=get_strbuf_by_int(table,42,buf,sizeof(buf),&length) || length!=strlen(record) || strcmp(buf,record))
+		return 1;
+	if(HASHOK!=get_strbuf_by_int(table,42,buf,10,&length) || length<10)
+		return 1;
+	if(HASHALREADYADDED!=add_str_by_int(table,42,record))
+		return 1;
+	get_compression_stats(table,&stats);
+	if(stats.values!=1 || stats.storedbytes>=stats.rawbytes)
+		return 1;
+	add_str_by_int(table,42,"gone short");
+	get_compression_stats(table,&stats);
+	if(stats.values!=0 || stats.rawbytes!=0 || stats.decodedbytes!=0 ||
+	   HASHOK!=get_str_by_int(table,42,&str) || strcmp(str,"gone short"))
+		return 1;
+	add_str_by_str(table,"long",record);
+	freeze_hash(table);
+	if(HASHOK!=get_str_by_str(table,"long",&str) || strcmp(str,record))
+		return 1;
+	delete_hash(table);
+
+	// a quarter million records, plain and compressed, then read them all back in scattered order
+	struct timeval tval_before, tval_done1, tval_done2, tval_done3, tval_done4;
+	struct timeval tval_plainadd, tval_plainget, tval_packadd, tval_packget;
+	jwHashTable * plain = create_hash(COMPRESSCOUNT);
+	size_t plainbytes = 0;
+	long int sum1 = 0, sum2 = 0;
+	int i,k;
+	table = create_hash(COMPRESSCOUNT);
+	enable_compression(table,(char *)dict,sizeof(dict)-1);
+	gettimeofday(&tval_before, NULL);
+	for(i=0;i<COMPRESSCOUNT;++i) {
+		make_record(record,i);
+		add_str_by_int(plain,i,record);
+		plainbytes += strlen(record)+1;
+	}
+	gettimeofday(&tval_done1, NULL);
+	for(i=0;i<COMPRESSCOUNT;++i) {
+		k = (int)(i*2654435761u%COMPRESSCOUNT);
+		get_strbuf_by_int(plain,k,buf,sizeof(buf),&length);
+		sum1 += length+buf[length/2];
+	}
+	gettimeofday(&tval_done2, NULL);
+	for(i=0;i<COMPRESSCOUNT;++i) {
+		make_record(record,i);
+		add_str_by_int(table,i,record);
+	}
+	gettimeofday(&tval_done3, NULL);
+	for(i=0;i<COMPRESSCOUNT;++i) {
+		k = (int)(i*2654435761u%COMPRESSCOUNT);
+		get_strbuf_by_int(table,k,buf,sizeof(buf),&length);
+		sum2 += length+buf[length/2];
+	}
+	gettimeofday(&tval_done4, NULL);
+	timersub(&tval_done1, &tval_before, &tval_plainadd);
+	timersub(&tval_done2, &tval_done1, &tval_plainget);
+	timersub(&tval_done3, &tval_done2, &tval_packadd);
+	timersub(&tval_done4, &tval_done3, &tval_packget);
+	if(sum1!=sum2) {
+		printf("Error: %ld != %ld\n",sum1,sum2);
+		return 1;
+	}
+	get_compression_stats(table,&stats);
+	printf("No errors.\n");
+	printf("%d records, %zu value bytes plain, %zu compressed (%zu dictionary)\n",
+		COMPRESSCOUNT,plainbytes,stats.storedbytes,stats.dictbytes);
+	printf("plain: add %ld.%06ld sec, get %ld.%06ld sec; compressed: add %ld.%06ld sec, get %ld.%06ld sec\n",
+		(long int)tval_plainadd.tv_sec, (long int)tval_plainadd.tv_usec,
+		(long int)tval_plainget.tv_sec, (long int)tval_plainget.tv_usec,
+		(long int)tval_packadd.tv_sec, (long int)tval_packadd.tv_usec,
+		(long int)tval_packget.tv_sec, (long int)tval_packget.tv_usec);
+	delete_hash(plain);
+	delete_hash(table);
+	return 0;
+}
+
+#define INDEXCOUNT HASHCOUNT
+#define INDEXRANGE (INDEXCOUNT/100)
+
+// collects scanned keys, stopping at max
+typedef struct scanlist {int count; int max; long int keys[8]; long int sum; long int last; int ordered;} scanlist;
+
+static int scan_collect(jwHashEntry *entry, void *arg)
+{
+	scanlist *list = (scanlist *)arg;
+	if(list->count<8)
+		list->keys[list->count] = entry->keytag==HASHKEYINT ? entry->key.intValue : (long int)entry->key.strValue[2];
+	if(entry->keytag==HASHKEYINT) {
+		if(list->count && entry->key.intValue<=list->last)
+			list->ordered = 0;
+		list->last = entry->key.intValue;
+		list->sum += entry->value.intValue;
+	}
+	return ++list->count==list->max;
+}
+
+int index_test()
+{
+	// prefixes in order, keys added and deleted after the index is built
+	jwHashTable * table = create_hash(10);
+	scanlist list;
+	long int * values;
+	size_t count;
+	int i,k;
+	add_int_by_str(table,"apricot",1);
+	add_int_by_str(table,"banana",2);
+	add_int_by_str(table,"apple",3);
+	add_int_by_str(table,"app",4);
+	if(HASHNOINDEX!=scan_prefix_by_str(table,"ap",scan_collect,&list))
+		return 1;
+	enable_index(table);
+	add_int_by_str(table,"apex",5);
+	del_by_str(table,"apple");
+	memset(&list,0,sizeof(list));
+	if(HASHOK!=scan_prefix_by_str(table,"ap",scan_collect,&list) || list.count!=3 ||
+	   list.keys[0]!='e' || list.keys[1]!='p' || list.keys[2]!='r')
+		return 1;
+	memset(&list,0,sizeof(list));
+	if(HASHNOTFOUND!=scan_prefix_by_str(table,"apq",scan_collect,&list) || list.count!=0)
+		return 1;
+
+	// ranges over keys added before and after, with deletes and a growing multi entry
+	for(i=0;i<1000;++i)
+		add_int_by_int(table,(i*7919)%1000,1);
+	disable_index(table);
+	enable_index(table);
+	for(i=1000;i<2000;++i)
+		add_int_by_int(table,i,1);
+	for(i=0;i<2000;i+=2)
+		del_by_int(table,i);
+	for(i=0;i<100;++i)
+		add_multi_by_int(table,5000,i);
+	memset(&list,0,sizeof(list));
+	list.ordered = 1;
+	if(HASHOK!=scan_range_by_int(table,500,1500,scan_collect,&list) || list.count!=500 || !list.ordered || list.keys[0]!=501)
+		return 1;
+	memset(&list,0,sizeof(list));
+	list.max = 3;
+	scan_range_by_int(table,-100,100000,scan_collect,&list);
+	if(list.count!=3 || list.keys[2]!=5)
+		return 1;
+	memset(&list,0,sizeof(list));
+	scan_range_by_int(table,5000,5000,scan_collect,&list);
+	if(list.count!=1 || HASHOK!=get_multi_by_int(table,5000,&values,&count) || count!=100)
+		return 1;
+	freeze_hash(table);
+	if(HASHFROZEN!=scan_range_by_int(table,0,10,scan_collect,&list))
+		return 1;
+	delete_hash(table);
+
+	// a built index puts 24 keys in a leaf, deleting 24 to 95 empties whole leaves,
+	// scans across the gap and starting inside it skip them
+	table = create_hash(100);
+	for(i=0;i<240;++i)
+		add_int_by_int(table,i,1);
+	enable_index(table);
+	for(i=24;i<96;++i)
+		del_by_int(table,i);
+	memset(&list,0,sizeof(list));
+	list.ordered = 1;
+	if(HASHOK!=scan_range_by_int(table,0,239,scan_collect,&list) || list.count!=168 || !list.ordered || list.last!=239)
+		return 1;
+	memset(&list,0,sizeof(list));
+	if(HASHNOTFOUND!=scan_range_by_int(table,30,60,scan_collect,&list) || list.count!=0)
+		return 1;
+	memset(&list,0,sizeof(list));
+	if(HASHOK!=scan_range_by_int(table,30,100,scan_collect,&list) || list.count!=5 || list.keys[0]!=96)
+		return 1;
+	delete_hash(table);
+
+	// a key loaded a hundred times as unique spans several leaves, each delete drops its own slot
+	jwHashPair pairs[101];
+	for(i=0;i<101;++i) {
+		pairs[i].key.intValue = i<100 ? 7 : 8;
+		pairs[i].valtag = HASHNUMERIC;
+		pairs[i].value.intValue = 1;
+	}
+	table = build_hash_from_array(pairs,101,HASHKEYINT,HASHBUILDUNIQUE);
+	enable_index(table);
+	for(i=0;i<60;++i)
+		del_by_int(table,7);
+	memset(&list,0,sizeof(list));
+	if(HASHOK!=scan_range_by_int(table,0,10,scan_collect,&list) || list.count!=41 || list.last!=8)
+		return 1;
+	delete_hash(table);
+
+	// a million keys added in scattered order with and without the index, then 1% range
+	// scans from the index and by walking the buckets, then delete them all again
+	struct timeval tval_before, tval_done1, tval_done2, tval_done3, tval_done4, tval_done5, tval_done6;
+	struct timeval tval_plainadd, tval_indexadd, tval_walk, tval_scan, tval_plaindel, tval_indexdel;
+	jwHashTable * plain = create_hash(INDEXCOUNT);
+	long int sum1 = 0, sum2 = 0;
+	table = create_hash(INDEXCOUNT);
+	enable_index(table);
+	gettimeofday(&tval_before, NULL);
+	for(i=0;i<INDEXCOUNT;++i) {
+		k = (int)(i*2654435761u%INDEXCOUNT);
+		add_int_by_int(plain,k,k);
+	}
+	gettimeofday(&tval_done1, NULL);
+	for(i=0;i<INDEXCOUNT;++i) {
+		k = (int)(i*2654435761u%INDEXCOUNT);
+		add_int_by_int(table,k,k);
+	}
+	gettimeofday(&tval_done2, NULL);
+	for(i=0;i<10;++i) {
+		size_t b;
+		long int lo = (long int)i*INDEXCOUNT/10;
+		for(b=0;b<plain->buckets;++b) {
+			jwHashEntry *entry;
+			for(entry=plain->bucket[b];entry;entry=entry->next)
+				if(entry->key.intValue>=lo && entry->key.intValue<lo+INDEXRANGE)
+					sum1 += entry->value.intValue;
+		}
+	}
+	gettimeofday(&tval_done3, NULL);
+	for(i=0;i<10;++i) {
+		long int lo = (long int)i*INDEXCOUNT/10;
+		memset(&list,0,sizeof(list));
+		list.ordered = 1;
+		scan_range_by_int(table,lo,lo+INDEXRANGE-1,scan_collect,&list);
+		if(!list.ordered)
+			return 1;
+		sum2 += list.sum;
+	}
+	gettimeofday(&tval_done4, NULL);
+	for(i=0;i<INDEXCOUNT;++i)
+		del_by_int(plain,(int)(i*2654435761u%INDEXCOUNT));
+	gettimeofday(&tval_done5, NULL);
+	for(i=0;i<INDEXCOUNT;++i)
+		del_by_int(table,(int)(i*2654435761u%INDEXCOUNT));
+	gettimeofday(&tval_done6, NULL);
+	timersub(&tval_done1, &tval_before, &tval_plainadd);
+	timersub(&tval_done2, &tval_done1, &tval_indexadd);
+	timersub(&tval_done3, &tval_done2, &tval_walk);
+	timersub(&tval_done4, &tval_done3, &tval_scan);
+	timersub(&tval_done5, &tval_done4, &tval_plaindel);
+	timersub(&tval_done6, &tval_done5, &tval_indexdel);
+	memset(&list,0,sizeof(list));
+	if(sum1!=sum2 || HASHNOTFOUND!=scan_range_by_int(table,0,INDEXCOUNT,scan_collect,&list)) {
+		printf("Error: %ld != %ld\n",sum1,sum2);
+		return 1;
+	}
+	printf("No errors.\n");
+	printf("%d keys, add %ld.%06ld sec plain, %ld.%06ld sec indexed; del %ld.%06ld sec plain, %ld.%06ld sec indexed\n",
+		INDEXCOUNT,
+		(long int)tval_plainadd.tv_sec, (long int)tval_plainadd.tv_usec,
+		(long int)tval_indexadd.tv_sec, (long int)tval_indexadd.tv_usec,
+		(long int)tval_plaindel.tv_sec, (long int)tval_plaindel.tv_usec,
+		(long int)tval_indexdel.tv_sec, (long int)tval_indexdel.tv_usec);
+	printf("10 scans of %d keys, bucket walk %ld.%06ld sec, index %ld.%06ld sec\n",
+		INDEXRANGE,
+		(long int)tval_walk.tv_sec, (long int)tval_walk.tv_usec,
+		(long int)tval_scan.tv_sec, (long int)tval_scan.tv_usec);
+	delete_hash(plain);
+	delete_hash(table);
+	return 0;
+}
+
+#ifdef __linux__
+#define SHAREDCOUNT HASHCOUNT
+#define SHAREDWORKERS 4
+#define SHAREDBYTES (256UL<<20)
+
+// each worker adds its share of the keys, by string and by int
+static int shared_worker(jwHashTable * table, int w)
+{
+	char key[32], value[32];
+	int i;
+	for(i=w;i<SHAREDCOUNT;i+=SHAREDWORKERS) {
+		sprintf(key,"%d",i);
+		sprintf(value,"value %d",i);
+		if(HASHOK!=add_int_by_str(table,key,i) || HASHOK!=add_str_by_int(table,i,value))
+			return 1;
+	}
+	return 0;
+}
+
+// attach by name, time it, and check a sample of the keys
+static int shared_attach(const char * name, int w)
+{
+	struct timeval tval_before, tval_done, tval_attach;
+	jwHashTable * table;
+	char key[32];
+	int i,v;
+	gettimeofday(&tval_before, NULL);
+	table = attach_shared_hash(name);
+	gettimeofday(&tval_done, NULL);
+	if(!table)
+		return 1;
+	for(i=w;i<SHAREDCOUNT;i+=97) {
+		sprintf(key,"%d",i);
+		if(HASHOK!=get_int_by_str(table,key,&v) || v!=i)
+			return 1;
+	}
+	timersub(&tval_done, &tval_before, &tval_attach);
+	sprintf(key,"attach %d",w);
+	add_int_by_str(table,key,tval_attach.tv_sec*1000000+tval_attach.tv_usec);
+	delete_hash(table);
+	return 0;
+}
+
+int shared_test()
+{
+	// a full segment, and replacing and deleting strings frees their space for reuse
+	jwHashSharedStats stats;
+	jwHashTable * table = create_shared_hash(NULL,16,4096);
+	char key[32], value[32], name[64], buf[32];
+	char * str;
+	size_t used,len;
+	int i,v,w,status,failed = 0;
+	pid_t pids[SHAREDWORKERS];
+	for(i=0;i<1000 && HASHOK==add_int_by_int(table,i,i);++i)
+		;
+	if(i==1000 || HASHNOSPACE!=add_int_by_int(table,i,i) || HASHSHARED!=freeze_hash(table))
+		return 1;
+	delete_hash(table);
+	table = create_shared_hash(NULL,16,4096);
+	add_str_by_str(table,"a","first value");
+	add_str_by_str(table,"a","second value");
+	get_shared_stats(table,&stats);
+	used = stats.used;
+	del_by_str(table,"a");
+	add_str_by_str(table,"b","third value");
+	get_shared_stats(table,&stats);
+	if(stats.entries!=1 || stats.used!=used || HASHSHARED!=get_str_by_str(table,"b",&str) ||
+	   HASHOK!=get_strbuf_by_str(table,"b",buf,sizeof(buf),&len) || strcmp(buf,"third value"))
+		return 1;
+	delete_hash(table);
+
+	// forked workers fill one anonymous table together
+	table = create_shared_hash(NULL,SHAREDCOUNT,SHAREDBYTES);
+	for(w=0;w<SHAREDWORKERS;++w) {
+		pids[w] = fork();
+		if(pids[w]==0)
+			_exit(shared_worker(table,w));
+	}
+	for(w=0;w<SHAREDWORKERS;++w) {
+		waitpid(pids[w],&status,0);
+		failed |= !WIFEXITED(status) || WEXITSTATUS(status);
+	}
+	for(i=0;i<SHAREDCOUNT && !failed;++i) {
+		sprintf(key,"%d",i);
+		sprintf(value,"value %d",i);
+		failed |= HASHOK!=get_int_by_str(table,key,&v) || v!=i;
+		failed |= HASHOK!=get_strbuf_by_int(table,i,buf,sizeof(buf),&len) || strcmp(buf,value);
+	}
+	get_shared_stats(table,&stats);
+	if(failed || stats.entries!=2*SHAREDCOUNT) {
+		printf("Error: shared table has %zu entries\n",stats.entries);
+		return 1;
+	}
+	delete_hash(table);
+
+	// one process builds a named table, the workers attach to it instead of each
+	// building their own
+	struct timeval tval_before, tval_done, tval_build;
+	long int attach = 0;
+	sprintf(name,"/jwhash_test_%d",(int)getpid());
+	gettimeofday(&tval_before, NULL);
+	table = create_shared_hash(name,SHAREDCOUNT,SHAREDBYTES);
+	if(!table)
+		return 1;
+	for(i=0;i<SHAREDCOUNT;++i) {
+		sprintf(key,"%d",i);
+		add_int_by_str(table,key,i);
+	}
+	gettimeofday(&tval_done, NULL);
+	timersub(&tval_done, &tval_before, &tval_build);
+	for(w=0;w<SHAREDWORKERS;++w) {
+		pids[w] = fork();
+		if(pids[w]==0)
+			_exit(shared_attach(name,w));
+	}
+	for(w=0;w<SHAREDWORKERS;++w) {
+		waitpid(pids[w],&status,0);
+		failed |= !WIFEXITED(status) || WEXITSTATUS(status);
+		sprintf(key,"attach %d",w);
+		failed |= HASHOK!=get_int_by_str(table,key,&v);
+		attach += v;
+	}
+	unlink_shared_hash(name);
+	get_shared_stats(table,&stats);
+	delete_hash(table);
+	if(failed || attach_shared_hash(name))
+		return 1;
+	printf("No errors.\n");
+	printf("%d keys, build %ld.%06ld sec, attach %ld usec per worker; %d workers share %zu MiB instead of %zu MiB\n",
+		SHAREDCOUNT,
+		(long int)tval_build.tv_sec, (long int)tval_build.tv_usec,
+		attach/SHAREDWORKERS,
+		SHAREDWORKERS,stats.used>>20,(SHAREDWORKERS*stats.used)>>20);
+	return 0;
+}
+#endif
+
 #endif
 #endif